@@ -0,0 +1,80 @@
+// Benchmark: xml_text::as_int / as_double with and without pugi::parse_fast_numbers.
+// Build: g++ -O2 -std=c++17 bench/numeric_conversion.cpp -o numeric_conversion
+// Usage: numeric_conversion [elements] [repetitions]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include "../lib/cpp/pugixml-1.14/src/pugixml.hpp"
+
+using namespace std;
+
+//---------------------------------------------------------------------
+// Builds a kingdom-shaped document with `elements` numeric leaf elements
+// (MAR/PTR/RT as integers, Time as decimal fractions).
+string buildDocument(int elements) {
+    string xml = "<Kingdom>";
+    xml.reserve(elements * 24);
+    srand(42);
+    for (int i = 0; i < elements; i += 4) {
+        xml += "<Clan><MAR>" + to_string(rand() % 100000) + "</MAR>";
+        xml += "<PTR>" + to_string(rand() % 100) + "</PTR>";
+        xml += "<RT>" + to_string(rand() % 1000) + "</RT>";
+        xml += "<Time>" + to_string(rand() % 1000) + "." + to_string(rand() % 1000) + "</Time></Clan>";
+    }
+    xml += "</Kingdom>";
+    return xml;
+}
+
+//---------------------------------------------------------------------
+// Converts every leaf of the document; returns checksum so the work can't be elided.
+double convertAll(const pugi::xml_document &doc, double &seconds) {
+    auto start = chrono::steady_clock::now();
+    double sum = 0;
+    for (pugi::xml_node clan : doc.child("Kingdom").children("Clan")) {
+        sum += clan.child("MAR").text().as_int();
+        sum += clan.child("PTR").text().as_int();
+        sum += clan.child("RT").text().as_int();
+        sum += clan.child("Time").text().as_double();
+    }
+    seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return sum;
+}
+
+double bestOf(const pugi::xml_document &doc, int repetitions, double &checksum) {
+    double best = 1e30;
+    for (int r = 0; r < repetitions; r++) {
+        double seconds;
+        checksum = convertAll(doc, seconds);
+        best = min(best, seconds);
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    int elements = argc > 1 ? atoi(argv[1]) : 1000000;
+    int repetitions = argc > 2 ? atoi(argv[2]) : 5;
+    string xml = buildDocument(elements);
+
+    pugi::xml_document regular, fast;
+    if (!regular.load_string(xml.c_str()) ||
+        !fast.load_string(xml.c_str(), pugi::parse_default | pugi::parse_fast_numbers)) {
+        cerr << "failed to parse generated document" << endl;
+        return 1;
+    }
+
+    double regularSum, fastSum;
+    double regularTime = bestOf(regular, repetitions, regularSum);
+    double fastTime = bestOf(fast, repetitions, fastSum);
+
+    cout << "elements: " << elements << endl;
+    cout << "strtod/string_to_integer: " << regularTime * 1e3 << " ms" << endl;
+    cout << "parse_fast_numbers:       " << fastTime * 1e3 << " ms" << endl;
+    cout << "speedup: " << regularTime / fastTime << "x" << endl;
+    if (regularSum != fastSum) {
+        cerr << "checksum mismatch: " << regularSum << " vs " << fastSum << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,300 @@
+// Benchmark: simulator hot paths (parseXML, getShortestDistance with each Dijkstra frontier, hub
+// label building and distance queries, processAttack, processStatus, event queue push/pop, query
+// line parsing, whole simulations with and without searches) over generated kingdoms. Every
+// benchmark also reports its heap allocations per operation.
+// Build: g++ -O2 -std=c++17 bench/simulator_hotpaths.cpp -o simulator_hotpaths
+// Usage: simulator_hotpaths [sizes, e.g. 100,1000,3000] [min seconds per benchmark] > results.json
+// Output follows the Google Benchmark JSON layout, so its compare.py can diff two runs.
+#include "../solution/kingdom_simulator.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+struct BenchmarkResult {
+    string name;
+    long long iterations;
+    double realNs;
+    double cpuNs;
+    double allocations;
+};
+
+// Results are folded into this so the compiler can't drop the measured calls.
+volatile long long benchmarkSink = 0;
+
+// Allocation counter: the global operator new is replaced, so every heap allocation is counted.
+atomic<long long> allocationCount{0};
+
+// What a benchmark spends on setup inside its body; left out of the reported numbers.
+long long setupAllocations = 0;
+chrono::steady_clock::duration setupTime{};
+
+// GCC pairs inlined library news with the free below and warns, though both sides are replaced.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void *operator new(size_t size) {
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Output sink that drops everything without buffering it.
+struct NullOutput : streambuf {
+    int overflow(int c) override { return traits_type::not_eof(c); }
+};
+
+//---------------------------------------------------------------------
+// Writes a kingdom with `clanCount` clans to `path`: a quarter of them are mines,
+// roads form a random spanning tree plus extra roads up to an average degree of 3.
+void writeKingdom(const string &path, int clanCount, mt19937 &rng) {
+    ofstream out(path);
+    out << "<Kingdom>\n  <Name>bench_kingdom</Name>\n";
+    for (int i = 0; i < clanCount; i++) {
+        out << "  <Clan>\n    <Name>clan_" << i << "</Name>\n";
+        if (rng() % 4 == 0) {
+            out << "    <IS_MINE>True</IS_MINE>\n";
+            out << "    <MAR>" << 10 + rng() % 190 << "</MAR>\n";
+            out << "    <RT>" << 1 + rng() % 120 << "</RT>\n";
+            out << "    <PTR>" << 1 + rng() % 3 << "</PTR>\n";
+        } else {
+            out << "    <IS_MINE>False</IS_MINE>\n";
+        }
+        out << "  </Clan>\n";
+    }
+    auto road = [&](int a, int b) {
+        out << "  <Road>\n      <From>clan_" << a << "</From>\n      <To>clan_" << b << "</To>\n";
+        out << "      <Time>" << 1 + rng() % 30 << "</Time>\n  </Road>\n";
+    };
+    for (int i = 1; i < clanCount; i++)
+        road(i, rng() % i);
+    for (int i = 0; i < clanCount / 2; i++)
+        road(rng() % clanCount, rng() % clanCount);
+    out << "</Kingdom>\n";
+}
+
+//---------------------------------------------------------------------
+// Runs `body` (which performs `batch` operations) until `minSeconds` have passed;
+// reports the mean time per operation.
+BenchmarkResult runBenchmark(const string &name, double minSeconds, long long batch, const function<void()> &body) {
+    long long iterations = 0;
+    setupAllocations = 0;
+    setupTime = {};
+    long long allocationStart = allocationCount;
+    clock_t cpuStart = clock();
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        body();
+        iterations += batch;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    double cpu = double(clock() - cpuStart) / CLOCKS_PER_SEC;
+    double setup = chrono::duration<double>(setupTime).count();
+    elapsed -= setup;
+    cpu -= setup; // benchmarks with setup are single-threaded
+    double allocations = double(allocationCount - allocationStart - setupAllocations) / iterations;
+    cerr << name << ": " << elapsed * 1e9 / iterations << " ns/op, " << allocations << " allocs/op" << endl;
+    return {name, iterations, elapsed * 1e9 / iterations, cpu * 1e9 / iterations, allocations};
+}
+
+void benchmarkSize(int clanCount, double minSeconds, vector<BenchmarkResult> &results) {
+    mt19937 rng(clanCount);
+    string suffix = "/" + to_string(clanCount);
+    string path = "bench_kingdom_" + to_string(clanCount) + ".xml";
+    writeKingdom(path, clanCount, rng);
+
+    auto model = make_shared<KingdomModel>();
+    results.push_back(runBenchmark("parseXML" + suffix, minSeconds, 1, [&] {
+        *model = KingdomModel();
+        model->load(path);
+        benchmarkSink += model->clans.size();
+    }));
+    remove(path.c_str());
+
+    // output of processStatus and processProduceGold
+    ostringstream discarded;
+    KingdomSimulator simulator(model, discarded, 0);
+
+    vector<string> names;
+    for (auto &p : simulator.clans)
+        names.push_back(p.first);
+    sort(names.begin(), names.end());
+
+    // the automatic choice first, then each frontier on the same kingdom
+    const pair<const char*, ShortestPathQueue> queues[] = {
+        {"", QUEUE_AUTO}, {"/binaryHeap", QUEUE_BINARY_HEAP}, {"/buckets", QUEUE_BUCKETS}, {"/radixHeap", QUEUE_RADIX_HEAP}
+    };
+    for (auto &queue : queues) {
+        simulator.pathQueue = queue.second;
+        results.push_back(runBenchmark("getShortestDistance" + string(queue.first) + suffix, minSeconds, 64, [&] {
+            for (int i = 0; i < 64; i++)
+                benchmarkSink += simulator.getShortestDistance(names[rng() % names.size()], names[rng() % names.size()]);
+        }));
+    }
+    simulator.pathQueue = QUEUE_AUTO;
+
+    HubLabels labels;
+    results.push_back(runBenchmark("hubLabels/build" + suffix, minSeconds, 1, [&] {
+        labels.build(model->roads);
+        benchmarkSink += labels.hubs.size();
+    }));
+    int labelled = int(labels.names.size());
+    results.push_back(runBenchmark("hubLabels/distance" + suffix, minSeconds, 64, [&] {
+        for (int i = 0; i < 64; i++)
+            benchmarkSink += labels.distance(rng() % labelled, rng() % labelled);
+    }));
+
+    // processAttack only reads mine state and schedules events, so repeated calls see the same kingdom.
+    vector<string> attacks;
+    for (int i = 0; i < 16; i++)
+        attacks.push_back("Attack on " + names[rng() % names.size()] + " with " + to_string(1 + rng() % 100) + " RR providing " + to_string(1 + rng() % 50) + " GCO");
+    results.push_back(runBenchmark("processAttack" + suffix, minSeconds, 1, [&] {
+        simulator.processAttack(0, attacks[rng() % attacks.size()]);
+        benchmarkSink += simulator.eventQueue.size();
+        simulator.clearEvents();
+    }));
+
+    results.push_back(runBenchmark("processStatus" + suffix, minSeconds, 1, [&] {
+        simulator.processStatus(0, "Show the current status of all the clans with mines");
+        benchmarkSink += discarded.tellp();
+        discarded.str("");
+    }));
+
+    // One push and one pop per operation, with the queue holding clanCount events.
+    vector<string> events;
+    for (int i = 0; i < clanCount; i++)
+        events.push_back("refill " + names[i]);
+    results.push_back(runBenchmark("eventQueue/pushPop" + suffix, minSeconds, clanCount, [&] {
+        for (int i = 0; i < clanCount; i++)
+            simulator.scheduleEvent(rng() % 100000, events[i]);
+        while (!simulator.eventQueue.empty()) {
+            benchmarkSink += simulator.eventQueue.top().time;
+            simulator.eventTexts.release(simulator.eventQueue.top().slot);
+            simulator.eventQueue.pop();
+        }
+    }));
+
+    vector<string> lines;
+    for (int i = 0; i < 1024; i++)
+        lines.push_back(to_string(i * 7) + ": " + attacks[i % attacks.size()]);
+    results.push_back(runBenchmark("parseQuery" + suffix, minSeconds, 1024, [&] {
+        int time;
+        string event;
+        for (auto &line : lines)
+            if (parseQuery(line, time, event))
+                benchmarkSink += time + event.size();
+    }));
+
+    // Steady-state event handling, per input line: attacks on a few targets with status and gold
+    // queries in between, without roads or blocks changing. Queueing the input and handling its
+    // first half, which builds the mine indexes and grows the pools, is setup.
+    vector<string> trace;
+    int time = 0, halfway = 0;
+    for (int i = 0; i < 4096; i++) {
+        if (i == 2048)
+            halfway = time;
+        time += rng() % 3;
+        if (i % 16 == 7)
+            trace.push_back(to_string(time) + ": Show the current status of all the clans with mines");
+        else if (i % 16 == 15)
+            trace.push_back(to_string(time) + ": Produce the current amount of Gold captured");
+        else
+            trace.push_back(to_string(time) + ": " + attacks[rng() % 4]);
+    }
+    NullOutput nullOutput;
+    ostream dropped(&nullOutput);
+    results.push_back(runBenchmark("processEvents" + suffix, minSeconds, trace.size() / 2, [&] {
+        long long setupStart = allocationCount;
+        auto setupClock = chrono::steady_clock::now();
+        KingdomSimulator run(model, dropped, 0);
+        for (auto &line : trace)
+            run.addQuery(line);
+        run.processEvents(halfway);
+        setupAllocations += allocationCount - setupStart;
+        setupTime += chrono::steady_clock::now() - setupClock;
+        run.run();
+        benchmarkSink += run.totalGoldCaptured;
+    }));
+
+    // The same with the routing changing: every fourth line blocks a clan for a while, so most
+    // attacks find no valid mine index and search, and now and then a clan becomes a mine.
+    vector<string> searchTrace;
+    time = 0;
+    for (int i = 0; i < 4096; i++) {
+        if (i == 2048)
+            halfway = time;
+        time += rng() % 3;
+        string at = to_string(time) + ": ";
+        if (i % 4 == 3)
+            searchTrace.push_back(at + names[rng() % names.size()] + " has been blocked by enemies for " + to_string(1 + rng() % 20) + " seconds");
+        else if (i % 64 == 62)
+            searchTrace.push_back(at + names[rng() % names.size()] + " has found natural resource's mine with " + to_string(10 + rng() % 190) + " MAR, 2 PTR and 30 RT");
+        else
+            searchTrace.push_back(at + attacks[rng() % attacks.size()]);
+    }
+    results.push_back(runBenchmark("processEvents/searching" + suffix, minSeconds, searchTrace.size() / 2, [&] {
+        long long setupStart = allocationCount;
+        auto setupClock = chrono::steady_clock::now();
+        KingdomSimulator run(model, dropped, 0);
+        for (auto &line : searchTrace)
+            run.addQuery(line);
+        run.processEvents(halfway);
+        setupAllocations += allocationCount - setupStart;
+        setupTime += chrono::steady_clock::now() - setupClock;
+        run.run();
+        benchmarkSink += run.totalGoldCaptured;
+    }));
+}
+
+//---------------------------------------------------------------------
+// Benchmark names are plain identifiers, so nothing needs escaping.
+void writeJson(ostream &out, const vector<BenchmarkResult> &results) {
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    out << "{\n  \"context\": {\n";
+    out << "    \"date\": \"" << date << "\",\n";
+    out << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+    out << "    \"library_build_type\": \"release\"\n";
+#else
+    out << "    \"library_build_type\": \"debug\"\n";
+#endif
+    out << "  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"run_name\": \"" << r.name << "\", \"run_type\": \"iteration\", "
+            << "\"iterations\": " << r.iterations << ", \"real_time\": " << r.realNs << ", \"cpu_time\": " << r.cpuNs
+            << ", \"time_unit\": \"ns\", \"allocs_per_op\": " << r.allocations << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    string sizes = argc > 1 ? argv[1] : "100,1000";
+    double minSeconds = argc > 2 ? atof(argv[2]) : 0.5;
+
+    vector<BenchmarkResult> results;
+    istringstream list(sizes);
+    string size;
+    while (getline(list, size, ','))
+        benchmarkSize(stoi(size), minSeconds, results);
+
+    writeJson(cout, results);
+    return 0;
+}
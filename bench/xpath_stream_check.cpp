@@ -0,0 +1,107 @@
+// Check: pugi::xpath_stream_query against select_nodes on the parsed document, for forward-axis
+// paths over a generated kingdom. Both must return the same nodes in document order (compared by
+// their printed form); then the time of each is reported. Paths whose predicates depend on the
+// position of an element among its siblings, which the stream can't see, must be rejected.
+// Build: g++ -O2 -std=c++17 bench/xpath_stream_check.cpp -o xpath_stream_check
+// Usage: xpath_stream_check [clans]; exits with 1 if any path differs or isn't rejected.
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../lib/cpp/pugixml-1.14/src/pugixml.hpp"
+#include "../lib/cpp/pugixml-1.14/src/pugixml.cpp"
+
+using namespace std;
+
+//---------------------------------------------------------------------
+// A kingdom-shaped document: clans (every third one a mine), roads, and some nesting and mixed
+// content so that descendant steps and text() have more than one level to look at.
+string buildDocument(int clans) {
+    ostringstream xml;
+    xml << "<Kingdom>\n  <Name>check</Name>\n";
+    for (int i = 0; i < clans; i++) {
+        xml << "  <Clan id=\"" << i << "\">\n    <Name>clan_" << i << "</Name>\n";
+        if (i % 3 == 0)
+            xml << "    <IS_MINE>True</IS_MINE>\n    <MAR>" << 10 + i % 90 << "</MAR>\n    <RT>" << 1 + i % 7 << "</RT>\n";
+        else
+            xml << "    <IS_MINE>False</IS_MINE>\n";
+        if (i % 5 == 0)
+            xml << "    <Note kind=\"n\">first <b>bold</b> last<Note kind=\"inner\">nested</Note></Note>\n";
+        xml << "  </Clan>\n";
+    }
+    for (int i = 1; i < clans; i++)
+        xml << "  <Road><From>clan_" << i << "</From><To>clan_" << i / 2 << "</To><Time>" << 1 + i % 9 << "</Time></Road>\n";
+    xml << "</Kingdom>\n";
+    return xml.str();
+}
+
+// Printed form of a result node: an element's subtree, an attribute's name and value, or the text.
+string describe(const pugi::xpath_node &node) {
+    if (node.attribute())
+        return string("@") + node.attribute().name() + "=" + node.attribute().value();
+    ostringstream out;
+    if (node.node().type() == pugi::node_element)
+        node.node().print(out, "", pugi::format_raw);
+    else
+        out << "text:" << node.node().value();
+    return out.str();
+}
+
+struct CollectMatches : pugi::xpath_stream_handler {
+    vector<string> matches;
+    bool match(const pugi::xpath_node &node) override {
+        matches.push_back(describe(node));
+        return true;
+    }
+};
+
+int main(int argc, char* argv[]) {
+    int clans = argc > 1 ? atoi(argv[1]) : 1000;
+    string xml = buildDocument(clans);
+    pugi::xml_document doc;
+    doc.load_buffer(xml.data(), xml.size());
+
+    const char *const paths[] = {
+        "/Kingdom/Name", "/Kingdom/Clan/Name/text()", "/Kingdom/Clan/@id", "//Clan[IS_MINE='True']/Name",
+        "//Road/Time", "/Kingdom/*/To/text()", "//Note", "//Note/@kind", "/Kingdom//b/text()",
+        "/descendant::Clan/child::MAR", "//Clan[MAR > 50]/RT/text()", "/Kingdom/Missing",
+        "//Clan[Note/Note[last()]]/Name",
+    };
+    const char *const rejected[] = {
+        "/Kingdom/Clan[2]", "/Kingdom/Clan[last()]", "/Kingdom/Clan[position() > 1]/Name",
+        "//Clan[IS_MINE='True' and position() = 1]", "//Road[last() - 1]/Time/text()",
+    };
+    int failures = 0;
+    for (const char *path : paths) {
+        auto start = chrono::steady_clock::now();
+        vector<string> expected;
+        for (const pugi::xpath_node &node : doc.select_nodes(path))
+            expected.push_back(describe(node));
+        double treeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        CollectMatches streamed;
+        pugi::xpath_stream_query query(path);
+        pugi::xml_parse_result result = query.evaluate_buffer(xml.data(), xml.size(), streamed);
+        double streamSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        bool same = result && streamed.matches == expected;
+        failures += !same;
+        cout << (same ? "ok   " : "FAIL ") << path << ": " << expected.size() << " nodes, select_nodes "
+             << treeSeconds * 1e3 << " ms (tree already parsed), stream " << streamSeconds * 1e3 << " ms" << endl;
+        if (!same)
+            cout << "     stream returned " << streamed.matches.size() << " nodes (" << result.description() << ")" << endl;
+    }
+    for (const char *path : rejected) {
+        bool compiled;
+        try {
+            compiled = bool(pugi::xpath_stream_query(path));
+        } catch (const pugi::xpath_exception &) {
+            compiled = false;
+        }
+        failures += compiled;
+        cout << (compiled ? "FAIL " : "ok   ") << path << ": " << (compiled ? "accepted" : "rejected") << endl;
+    }
+    return failures ? 1 : 0;
+}
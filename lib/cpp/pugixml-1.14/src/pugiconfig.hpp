@@ -23,6 +23,12 @@
 // Uncomment this to disable XPath
 // #define PUGIXML_NO_XPATH
 
+// Uncomment this to disable the process-wide XPath query cache and parallel XPath evaluation
+// #define PUGIXML_NO_XPATH_CACHE
+
+// Uncomment this to disable SSE2 code paths in encoding conversion
+// #define PUGIXML_NO_SIMD
+
 // Uncomment this to disable STL
 // #define PUGIXML_NO_STL
 
@@ -38,11 +44,15 @@
 // Tune these constants to adjust memory-related behavior
 // #define PUGIXML_MEMORY_PAGE_SIZE 32768
 // #define PUGIXML_MEMORY_OUTPUT_STACK 10240
+// #define PUGIXML_MEMORY_OUTPUT_HEAP 65536
 // #define PUGIXML_MEMORY_XPATH_PAGE_SIZE 4096
 
 // Tune this constant to adjust max nesting for XPath queries
 // #define PUGIXML_XPATH_DEPTH_LIMIT 1024
 
+// Tune this constant to adjust max number of compiled queries kept in the XPath query cache
+// #define PUGIXML_XPATH_CACHE_CAPACITY 1024
+
 // Uncomment this to switch to header-only version
 #define PUGIXML_HEADER_ONLY
 
@@ -40,11 +40,35 @@
 // For placement new
 #include <new>
 
+#ifdef PUGIXML_HAS_XPATH_CACHE
+#	include <atomic>
+#	include <exception>
+#	include <mutex>
+#	include <thread>
+#	include <vector>
+#endif
+
 // For load_file
 #if defined(__linux__) || defined(__APPLE__)
 #include <sys/stat.h>
 #endif
 
+// For parse_fast_numbers; std::from_chars only works with char, and floating-point overloads are a C++17 library feature
+#if !defined(PUGIXML_WCHAR_MODE) && (__cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)) && defined(__has_include)
+#	if __has_include(<charconv>)
+#		include <charconv>
+#		if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#			define PUGI_IMPL_HAS_FROM_CHARS
+#		endif
+#	endif
+#endif
+
+// For vectorized encoding conversion
+#if !defined(PUGIXML_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	include <emmintrin.h>
+#	define PUGI_IMPL_HAS_SSE2
+#endif
+
 #ifdef _MSC_VER
 #	pragma warning(push)
 #	pragma warning(disable: 4127) // conditional expression is constant
@@ -101,6 +125,13 @@
 #	define PUGI_IMPL_UNLIKELY(cond) (cond)
 #endif
 
+// Sanitizer controls
+#if defined(__GNUC__) || defined(__clang__)
+#	define PUGI_IMPL_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#else
+#	define PUGI_IMPL_NO_SANITIZE_ADDRESS
+#endif
+
 // Simple static assertion
 #define PUGI_IMPL_STATIC_ASSERT(cond) { static const char condition_failed[(cond) ? 1 : -1] = {0}; (void)condition_failed[0]; }
 
@@ -1156,7 +1187,7 @@ PUGI_IMPL_NS_BEGIN
 
 	struct xml_document_struct: public xml_node_struct, public xml_allocator
 	{
-		xml_document_struct(xml_memory_page* page): xml_node_struct(page, node_document), xml_allocator(page), buffer(0), extra_buffers(0)
+		xml_document_struct(xml_memory_page* page): xml_node_struct(page, node_document), xml_allocator(page), buffer(0), extra_buffers(0), fast_numbers(false)
 		{
 		}
 
@@ -1164,6 +1195,9 @@ PUGI_IMPL_NS_BEGIN
 
 		xml_extra_buffer* extra_buffers;
 
+		// set by parse_fast_numbers
+		bool fast_numbers;
+
 	#ifdef PUGIXML_COMPACT
 		compact_hash_table hash;
 	#endif
@@ -1646,6 +1680,194 @@ PUGI_IMPL_NS_BEGIN
 		}
 	};
 
+	// Length of the run of ascii code units at the start of data; with opt_swap, code units are stored byte-swapped
+	template <typename opt_swap, typename T> PUGI_IMPL_FN size_t get_ascii_length(const T* data, size_t size)
+	{
+		// bits that have to be clear in an ascii code unit, as it is laid out in memory
+		const T mask = static_cast<T>(~(static_cast<T>(0x7f) << (opt_swap::value ? sizeof(T) * 8 - 8 : 0)));
+
+		size_t i = 0;
+
+	#ifdef PUGI_IMPL_HAS_SSE2
+		const size_t block = 32 / sizeof(T);
+
+		T mask_lanes[16 / sizeof(T)];
+		for (size_t k = 0; k < 16 / sizeof(T); ++k) mask_lanes[k] = mask;
+
+		const __m128i vmask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask_lanes));
+
+		// 32 bytes per iteration
+		for (; i + block <= size; i += block)
+		{
+			__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + block / 2));
+			__m128i bits = _mm_and_si128(_mm_or_si128(v0, v1), vmask);
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128())) != 0xffff)
+				break;
+		}
+	#else
+		const size_t block = sizeof(size_t) / sizeof(T);
+
+		size_t mask_word = 0;
+		for (size_t k = 0; k < block; ++k) mask_word = (mask_word << (sizeof(T) * 4) << (sizeof(T) * 4)) | mask;
+
+		// one machine word per iteration; memcpy keeps unaligned input well-defined
+		for (; i + block <= size; i += block)
+		{
+			size_t word;
+			memcpy(&word, data + i, sizeof(word));
+
+			if (word & mask_word)
+				break;
+		}
+	#endif
+
+		while (i < size && (data[i] & mask) == 0) ++i;
+
+		return i;
+	}
+
+	// Converts a run of ascii code units; the generic version goes through the writer one unit at a time
+	template <typename opt_swap, typename T, typename Traits> PUGI_IMPL_FN typename Traits::value_type process_ascii(const T* data, size_t size, typename Traits::value_type result, Traits)
+	{
+		for (size_t i = 0; i < size; ++i)
+			result = Traits::low(result, static_cast<uint32_t>(opt_swap::value ? data[i] >> (sizeof(T) * 8 - 8) : data[i]));
+
+		return result;
+	}
+
+	template <typename opt_swap, typename T> PUGI_IMPL_FN size_t process_ascii(const T*, size_t size, size_t result, utf8_counter)
+	{
+		return result + size;
+	}
+
+	template <typename opt_swap, typename T> PUGI_IMPL_FN size_t process_ascii(const T*, size_t size, size_t result, utf16_counter)
+	{
+		return result + size;
+	}
+
+	template <typename opt_swap, typename T> PUGI_IMPL_FN size_t process_ascii(const T*, size_t size, size_t result, utf32_counter)
+	{
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint8_t* process_ascii(const uint8_t* data, size_t size, uint8_t* result, utf8_writer)
+	{
+		memcpy(result, data, size);
+
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint8_t* process_ascii(const uint8_t* data, size_t size, uint8_t* result, latin1_writer)
+	{
+		memcpy(result, data, size);
+
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint8_t* process_ascii(const uint16_t* data, size_t size, uint8_t* result, utf8_writer)
+	{
+		size_t i = 0;
+
+	#ifdef PUGI_IMPL_HAS_SSE2
+		// narrow 16 code units per iteration; ascii values never saturate
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 8));
+
+			if (opt_swap::value)
+			{
+				v0 = _mm_srli_epi16(v0, 8);
+				v1 = _mm_srli_epi16(v1, 8);
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), _mm_packus_epi16(v0, v1));
+		}
+	#endif
+
+		for (; i < size; ++i)
+			result[i] = static_cast<uint8_t>(opt_swap::value ? data[i] >> 8 : data[i]);
+
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint8_t* process_ascii(const uint32_t* data, size_t size, uint8_t* result, utf8_writer)
+	{
+		size_t i = 0;
+
+	#ifdef PUGI_IMPL_HAS_SSE2
+		// narrow 8 code units per iteration; ascii values never saturate
+		for (; i + 8 <= size; i += 8)
+		{
+			__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 4));
+
+			if (opt_swap::value)
+			{
+				v0 = _mm_srli_epi32(v0, 24);
+				v1 = _mm_srli_epi32(v1, 24);
+			}
+
+			__m128i v = _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_setzero_si128());
+
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(result + i), v);
+		}
+	#endif
+
+		for (; i < size; ++i)
+			result[i] = static_cast<uint8_t>(opt_swap::value ? data[i] >> 24 : data[i]);
+
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint16_t* process_ascii(const uint8_t* data, size_t size, uint16_t* result, utf16_writer)
+	{
+		size_t i = 0;
+
+	#ifdef PUGI_IMPL_HAS_SSE2
+		// widen 16 bytes per iteration
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i + 8), _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+		}
+	#endif
+
+		for (; i < size; ++i)
+			result[i] = data[i];
+
+		return result + size;
+	}
+
+	template <typename opt_swap> PUGI_IMPL_FN uint32_t* process_ascii(const uint8_t* data, size_t size, uint32_t* result, utf32_writer)
+	{
+		size_t i = 0;
+
+	#ifdef PUGI_IMPL_HAS_SSE2
+		// widen 16 bytes per iteration
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+			__m128i lo = _mm_unpacklo_epi8(v, _mm_setzero_si128());
+			__m128i hi = _mm_unpackhi_epi8(v, _mm_setzero_si128());
+
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i), _mm_unpacklo_epi16(lo, _mm_setzero_si128()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i + 4), _mm_unpackhi_epi16(lo, _mm_setzero_si128()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i + 8), _mm_unpacklo_epi16(hi, _mm_setzero_si128()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result + i + 12), _mm_unpackhi_epi16(hi, _mm_setzero_si128()));
+		}
+	#endif
+
+		for (; i < size; ++i)
+			result[i] = data[i];
+
+		return result + size;
+	}
+
 	struct utf8_decoder
 	{
 		typedef uint8_t type;
@@ -1658,27 +1880,14 @@ PUGI_IMPL_NS_BEGIN
 			{
 				uint8_t lead = *data;
 
-				// 0xxxxxxx -> U+0000..U+007F
+				// 0xxxxxxx -> U+0000..U+007F; process the whole ascii run at once
 				if (lead < 0x80)
 				{
-					result = Traits::low(result, lead);
-					data += 1;
-					size -= 1;
+					size_t run = get_ascii_length<opt_false>(data, size);
 
-					// process aligned single-byte (ascii) blocks
-					if ((reinterpret_cast<uintptr_t>(data) & 3) == 0)
-					{
-						// round-trip through void* to silence 'cast increases required alignment of target type' warnings
-						while (size >= 4 && (*static_cast<const uint32_t*>(static_cast<const void*>(data)) & 0x80808080) == 0)
-						{
-							result = Traits::low(result, data[0]);
-							result = Traits::low(result, data[1]);
-							result = Traits::low(result, data[2]);
-							result = Traits::low(result, data[3]);
-							data += 4;
-							size -= 4;
-						}
-					}
+					result = process_ascii<opt_false>(data, run, result, Traits());
+					data += run;
+					size -= run;
 				}
 				// 110xxxxx -> U+0080..U+07FF
 				else if (static_cast<unsigned int>(lead - 0xC0) < 0x20 && size >= 2 && (data[1] & 0xc0) == 0x80)
@@ -1723,8 +1932,17 @@ PUGI_IMPL_NS_BEGIN
 			{
 				uint16_t lead = opt_swap::value ? endian_swap(*data) : *data;
 
-				// U+0000..U+D7FF
-				if (lead < 0xD800)
+				// U+0000..U+007F; process the whole ascii run at once
+				if (lead < 0x80)
+				{
+					size_t run = get_ascii_length<opt_swap>(data, size);
+
+					result = process_ascii<opt_swap>(data, run, result, Traits());
+					data += run;
+					size -= run;
+				}
+				// U+0080..U+D7FF
+				else if (lead < 0xD800)
 				{
 					result = Traits::low(result, lead);
 					data += 1;
@@ -1775,8 +1993,17 @@ PUGI_IMPL_NS_BEGIN
 			{
 				uint32_t lead = opt_swap::value ? endian_swap(*data) : *data;
 
-				// U+0000..U+FFFF
-				if (lead < 0x10000)
+				// U+0000..U+007F; process the whole ascii run at once
+				if (lead < 0x80)
+				{
+					size_t run = get_ascii_length<opt_swap>(data, size);
+
+					result = process_ascii<opt_swap>(data, run, result, Traits());
+					data += run;
+					size -= run;
+				}
+				// U+0080..U+FFFF
+				else if (lead < 0x10000)
 				{
 					result = Traits::low(result, lead);
 					data += 1;
@@ -1803,9 +2030,21 @@ PUGI_IMPL_NS_BEGIN
 		{
 			while (size)
 			{
-				result = Traits::low(result, *data);
-				data += 1;
-				size -= 1;
+				// U+0000..U+007F; process the whole ascii run at once
+				if (*data < 0x80)
+				{
+					size_t run = get_ascii_length<opt_false>(data, size);
+
+					result = process_ascii<opt_false>(data, run, result, Traits());
+					data += run;
+					size -= run;
+				}
+				else
+				{
+					result = Traits::low(result, *data);
+					data += 1;
+					size -= 1;
+				}
 			}
 
 			return result;
@@ -2228,11 +2467,7 @@ PUGI_IMPL_NS_BEGIN
 
 	PUGI_IMPL_FN size_t get_latin1_7bit_prefix_length(const uint8_t* data, size_t size)
 	{
-		for (size_t i = 0; i < size; ++i)
-			if (data[i] > 127)
-				return i;
-
-		return size;
+		return get_ascii_length<opt_false>(data, size);
 	}
 
 	PUGI_IMPL_FN bool convert_buffer_latin1(char_t*& out_buffer, size_t& out_length, const void* contents, size_t size, bool is_mutable)
@@ -3745,9 +3980,15 @@ PUGI_IMPL_NS_BEGIN
 		xml_buffered_writer& operator=(const xml_buffered_writer&);
 
 	public:
-		xml_buffered_writer(xml_writer& writer_, xml_encoding user_encoding): writer(writer_), bufsize(0), encoding(get_write_encoding(user_encoding))
+		xml_buffered_writer(xml_writer& writer_, xml_encoding user_encoding): buffer(buffer_stack), scratch(&scratch_stack), bufcapacity(bufcapacity_stack), writer(writer_), bufsize(0), encoding(get_write_encoding(user_encoding)), heap_tried(false)
+		{
+			PUGI_IMPL_STATIC_ASSERT(bufcapacity_stack >= 8);
+		}
+
+		~xml_buffered_writer()
 		{
-			PUGI_IMPL_STATIC_ASSERT(bufcapacity >= 8);
+			if (buffer != buffer_stack)
+				xml_memory::deallocate(buffer);
 		}
 
 		size_t flush()
@@ -3757,6 +3998,37 @@ PUGI_IMPL_NS_BEGIN
 			return 0;
 		}
 
+		// flushes a full buffer; the first time the stack buffer fills up, output continues in a larger heap buffer,
+		// which means fewer, bigger xml_writer::write calls for large documents while small ones never allocate
+		size_t flush_overflow()
+		{
+			flush();
+
+			if (!heap_tried)
+			{
+				heap_tried = true;
+
+				// heap capacity is a multiple of 4 so that the scratch area that follows the buffer is aligned for uint32_t
+				size_t heap_capacity = (static_cast<size_t>(bufcapacityheapbytes) / (sizeof(char_t) + 4)) & ~static_cast<size_t>(3);
+
+				if (heap_capacity > static_cast<size_t>(bufcapacity_stack))
+				{
+					// scratch space is only needed for encoding conversion
+					size_t scratch_size = (encoding == get_write_native_encoding()) ? 0 : 4 * heap_capacity;
+
+					// keep the stack buffer if allocation fails
+					if (void* memory = xml_memory::allocate(heap_capacity * sizeof(char_t) + scratch_size))
+					{
+						buffer = static_cast<char_t*>(memory);
+						scratch = buffer + heap_capacity;
+						bufcapacity = heap_capacity;
+					}
+				}
+			}
+
+			return 0;
+		}
+
 		void flush(const char_t* data, size_t size)
 		{
 			if (size == 0) return;
@@ -3767,18 +4039,18 @@ PUGI_IMPL_NS_BEGIN
 			else
 			{
 				// convert chunk
-				size_t result = convert_buffer_output(scratch.data_char, scratch.data_u8, scratch.data_u16, scratch.data_u32, data, size, encoding);
-				assert(result <= sizeof(scratch));
+				size_t result = convert_buffer_output(static_cast<char_t*>(scratch), static_cast<uint8_t*>(scratch), static_cast<uint16_t*>(scratch), static_cast<uint32_t*>(scratch), data, size, encoding);
+				assert(result <= 4 * bufcapacity);
 
 				// write data
-				writer.write(scratch.data_u8, result);
+				writer.write(scratch, result);
 			}
 		}
 
 		void write_direct(const char_t* data, size_t length)
 		{
 			// flush the remaining buffer contents
-			flush();
+			flush_overflow();
 
 			// handle large chunks
 			if (length > bufcapacity)
@@ -3857,7 +4129,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 1) offset = flush();
+			if (offset > bufcapacity - 1) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			bufsize = offset + 1;
@@ -3866,7 +4138,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0, char_t d1)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 2) offset = flush();
+			if (offset > bufcapacity - 2) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			buffer[offset + 1] = d1;
@@ -3876,7 +4148,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0, char_t d1, char_t d2)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 3) offset = flush();
+			if (offset > bufcapacity - 3) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			buffer[offset + 1] = d1;
@@ -3887,7 +4159,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0, char_t d1, char_t d2, char_t d3)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 4) offset = flush();
+			if (offset > bufcapacity - 4) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			buffer[offset + 1] = d1;
@@ -3899,7 +4171,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0, char_t d1, char_t d2, char_t d3, char_t d4)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 5) offset = flush();
+			if (offset > bufcapacity - 5) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			buffer[offset + 1] = d1;
@@ -3912,7 +4184,7 @@ PUGI_IMPL_NS_BEGIN
 		void write(char_t d0, char_t d1, char_t d2, char_t d3, char_t d4, char_t d5)
 		{
 			size_t offset = bufsize;
-			if (offset > bufcapacity - 6) offset = flush();
+			if (offset > bufcapacity - 6) offset = flush_overflow();
 
 			buffer[offset + 0] = d0;
 			buffer[offset + 1] = d1;
@@ -3935,30 +4207,81 @@ PUGI_IMPL_NS_BEGIN
 				10240
 			#endif
 			,
-			bufcapacity = bufcapacitybytes / (sizeof(char_t) + 4)
+			bufcapacity_stack = bufcapacitybytes / (sizeof(char_t) + 4),
+			bufcapacityheapbytes =
+			#ifdef PUGIXML_MEMORY_OUTPUT_HEAP
+				PUGIXML_MEMORY_OUTPUT_HEAP
+			#else
+				65536
+			#endif
 		};
 
-		char_t buffer[bufcapacity];
+		char_t buffer_stack[bufcapacity_stack];
 
 		union
 		{
-			uint8_t data_u8[4 * bufcapacity];
-			uint16_t data_u16[2 * bufcapacity];
-			uint32_t data_u32[bufcapacity];
-			char_t data_char[bufcapacity];
-		} scratch;
+			uint8_t data_u8[4 * bufcapacity_stack];
+			uint16_t data_u16[2 * bufcapacity_stack];
+			uint32_t data_u32[bufcapacity_stack];
+			char_t data_char[bufcapacity_stack];
+		} scratch_stack;
+
+		char_t* buffer;
+		void* scratch;
+		size_t bufcapacity;
 
 		xml_writer& writer;
 		size_t bufsize;
 		xml_encoding encoding;
+		bool heap_tried;
 	};
 
+#if defined(PUGI_IMPL_HAS_SSE2) && !defined(PUGIXML_WCHAR_MODE)
+	// Skips 16-byte blocks with no character that may need escaping in either context (control characters, &, <, >, ", ');
+	// loads are aligned so that reading past the terminator never crosses into the next page
+	PUGI_IMPL_NO_SANITIZE_ADDRESS PUGI_IMPL_FN const char_t* text_output_skip_unescaped(const char_t* s)
+	{
+		while (reinterpret_cast<uintptr_t>(s) & 15)
+		{
+			if (PUGI_IMPL_IS_CHARTYPEX(*s, ctx_special_pcdata | ctx_special_attr)) return s;
+			++s;
+		}
+
+		const __m128i control = _mm_set1_epi8(31);
+		const __m128i amp = _mm_set1_epi8('&');
+		const __m128i lt = _mm_set1_epi8('<');
+		const __m128i gt = _mm_set1_epi8('>');
+		const __m128i quot = _mm_set1_epi8('"');
+		const __m128i apos = _mm_set1_epi8('\'');
+
+		for (;;)
+		{
+			__m128i v = _mm_load_si128(reinterpret_cast<const __m128i*>(s));
+
+			// unsigned v <= 31 also catches the terminator
+			__m128i special = _mm_cmpeq_epi8(_mm_min_epu8(v, control), v);
+			special = _mm_or_si128(special, _mm_or_si128(_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, lt)));
+			special = _mm_or_si128(special, _mm_or_si128(_mm_cmpeq_epi8(v, gt), _mm_cmpeq_epi8(v, quot)));
+			special = _mm_or_si128(special, _mm_cmpeq_epi8(v, apos));
+
+			// the exact position is found by the scalar scan that follows
+			if (_mm_movemask_epi8(special)) return s;
+
+			s += 16;
+		}
+	}
+#endif
+
 	PUGI_IMPL_FN void text_output_escaped(xml_buffered_writer& writer, const char_t* s, chartypex_t type, unsigned int flags)
 	{
 		while (*s)
 		{
 			const char_t* prev = s;
 
+		#if defined(PUGI_IMPL_HAS_SSE2) && !defined(PUGIXML_WCHAR_MODE)
+			s = text_output_skip_unescaped(s);
+		#endif
+
 			// While *s is a usual symbol
 			PUGI_IMPL_SCANWHILE_UNROLL(!PUGI_IMPL_IS_CHARTYPEX(ss, type));
 
@@ -4626,18 +4949,47 @@ PUGI_IMPL_NS_BEGIN
 			return (overflow || result > maxv) ? maxv : result;
 	}
 
-	PUGI_IMPL_FN int get_value_int(const char_t* value)
+	// Locale-independent conversion for values that consist of a plain decimal number and nothing else;
+	// everything else (whitespace, '+' sign, hexadecimal, trailing characters, overflow) goes through the regular conversion
+	template <typename T> PUGI_IMPL_FN bool get_value_fast(const char_t* value, bool fast, T& result)
+	{
+	#ifdef PUGI_IMPL_HAS_FROM_CHARS
+		if (!fast) return false;
+
+		const char_t* end = value + strlength(value);
+		std::from_chars_result r = std::from_chars(value, end, result);
+
+		return r.ec == std::errc() && r.ptr == end;
+	#else
+		(void)value;
+		(void)fast;
+		(void)result;
+
+		return false;
+	#endif
+	}
+
+	PUGI_IMPL_FN int get_value_int(const char_t* value, bool fast)
 	{
+		int result;
+		if (get_value_fast(value, fast, result)) return result;
+
 		return string_to_integer<unsigned int>(value, static_cast<unsigned int>(INT_MIN), INT_MAX);
 	}
 
-	PUGI_IMPL_FN unsigned int get_value_uint(const char_t* value)
+	PUGI_IMPL_FN unsigned int get_value_uint(const char_t* value, bool fast)
 	{
+		unsigned int result;
+		if (get_value_fast(value, fast, result)) return result;
+
 		return string_to_integer<unsigned int>(value, 0, UINT_MAX);
 	}
 
-	PUGI_IMPL_FN double get_value_double(const char_t* value)
+	PUGI_IMPL_FN double get_value_double(const char_t* value, bool fast)
 	{
+		double result;
+		if (get_value_fast(value, fast, result)) return result;
+
 	#ifdef PUGIXML_WCHAR_MODE
 		return wcstod(value, 0);
 	#else
@@ -4645,8 +4997,12 @@ PUGI_IMPL_NS_BEGIN
 	#endif
 	}
 
-	PUGI_IMPL_FN float get_value_float(const char_t* value)
+	PUGI_IMPL_FN float get_value_float(const char_t* value, bool fast)
 	{
+		// parse as double and round to float, like the strtod path
+		double result;
+		if (get_value_fast(value, fast, result)) return static_cast<float>(result);
+
 	#ifdef PUGIXML_WCHAR_MODE
 		return static_cast<float>(wcstod(value, 0));
 	#else
@@ -4664,13 +5020,19 @@ PUGI_IMPL_NS_BEGIN
 	}
 
 #ifdef PUGIXML_HAS_LONG_LONG
-	PUGI_IMPL_FN long long get_value_llong(const char_t* value)
+	PUGI_IMPL_FN long long get_value_llong(const char_t* value, bool fast)
 	{
+		long long result;
+		if (get_value_fast(value, fast, result)) return result;
+
 		return string_to_integer<unsigned long long>(value, static_cast<unsigned long long>(LLONG_MIN), LLONG_MAX);
 	}
 
-	PUGI_IMPL_FN unsigned long long get_value_ullong(const char_t* value)
+	PUGI_IMPL_FN unsigned long long get_value_ullong(const char_t* value, bool fast)
 	{
+		unsigned long long result;
+		if (get_value_fast(value, fast, result)) return result;
+
 		return string_to_integer<unsigned long long>(value, 0, ULLONG_MAX);
 	}
 #endif
@@ -4776,6 +5138,8 @@ PUGI_IMPL_NS_BEGIN
 		// store buffer for offset_debug
 		doc->buffer = buffer;
 
+		if (options & parse_fast_numbers) doc->fast_numbers = true;
+
 		// parse
 		xml_parse_result res = impl::xml_parser::parse(buffer, length, doc, root, options);
 
@@ -5110,6 +5474,9 @@ PUGI_IMPL_NS_BEGIN
 	{
 		if (!file) return false;
 
+		// xml_buffered_writer already hands out large blocks; stdio buffering would only add a copy per block
+		setvbuf(file, 0, _IONBF, 0);
+
 		xml_writer_file writer(file);
 		doc.save(writer, indent, flags, encoding);
 
@@ -5274,28 +5641,28 @@ namespace pugi
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_int(value) : def;
+		return value ? impl::get_value_int(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN unsigned int xml_attribute::as_uint(unsigned int def) const
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_uint(value) : def;
+		return value ? impl::get_value_uint(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN double xml_attribute::as_double(double def) const
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_double(value) : def;
+		return value ? impl::get_value_double(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN float xml_attribute::as_float(float def) const
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_float(value) : def;
+		return value ? impl::get_value_float(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN bool xml_attribute::as_bool(bool def) const
@@ -5310,14 +5677,14 @@ namespace pugi
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_llong(value) : def;
+		return value ? impl::get_value_llong(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN unsigned long long xml_attribute::as_ullong(unsigned long long def) const
 	{
 		if (!_attr) return def;
 		const char_t* value = _attr->value;
-		return value ? impl::get_value_ullong(value) : def;
+		return value ? impl::get_value_ullong(value, impl::get_document(_attr).fast_numbers) : def;
 	}
 #endif
 
@@ -6675,7 +7042,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_int(value) : def;
+		return value ? impl::get_value_int(value, impl::get_document(d).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN unsigned int xml_text::as_uint(unsigned int def) const
@@ -6683,7 +7050,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_uint(value) : def;
+		return value ? impl::get_value_uint(value, impl::get_document(d).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN double xml_text::as_double(double def) const
@@ -6691,7 +7058,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_double(value) : def;
+		return value ? impl::get_value_double(value, impl::get_document(d).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN float xml_text::as_float(float def) const
@@ -6699,7 +7066,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_float(value) : def;
+		return value ? impl::get_value_float(value, impl::get_document(d).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN bool xml_text::as_bool(bool def) const
@@ -6716,7 +7083,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_llong(value) : def;
+		return value ? impl::get_value_llong(value, impl::get_document(d).fast_numbers) : def;
 	}
 
 	PUGI_IMPL_FN unsigned long long xml_text::as_ullong(unsigned long long def) const
@@ -6724,7 +7091,7 @@ namespace pugi
 		xml_node_struct* d = _data();
 		if (!d) return def;
 		const char_t* value = d->value;
-		return value ? impl::get_value_ullong(value) : def;
+		return value ? impl::get_value_ullong(value, impl::get_document(d).fast_numbers) : def;
 	}
 #endif
 
@@ -12366,76 +12733,1062 @@ PUGI_IMPL_NS_BEGIN
 
 		return impl->root;
 	}
-PUGI_IMPL_NS_END
 
-namespace pugi
-{
-#ifndef PUGIXML_NO_EXCEPTIONS
-	PUGI_IMPL_FN xpath_exception::xpath_exception(const xpath_parse_result& result_): _result(result_)
-	{
-		assert(_result.error);
-	}
+#ifdef PUGIXML_HAS_XPATH_CACHE
+	static const size_t xpath_query_cache_capacity =
+	#ifdef PUGIXML_XPATH_CACHE_CAPACITY
+		PUGIXML_XPATH_CACHE_CAPACITY
+	#else
+		1024
+	#endif
+		;
 
-	PUGI_IMPL_FN const char* xpath_exception::what() const throw()
+	struct xpath_query_cache_entry
 	{
-		return _result.error;
-	}
+		xpath_query_cache_entry* next;
+		xpath_query query;
+		char_t text[1];
 
-	PUGI_IMPL_FN const xpath_parse_result& xpath_exception::result() const
-	{
-		return _result;
-	}
-#endif
+		static xpath_query_cache_entry* create(const char_t* text)
+		{
+			size_t length = strlength(text);
 
-	PUGI_IMPL_FN xpath_node::xpath_node()
-	{
-	}
+			// we can't use offsetof here since xpath_query is not a POD type; text has enough padding for the trailing zero
+			void* memory = xml_memory::allocate(sizeof(xpath_query_cache_entry) + length * sizeof(char_t));
+			if (!memory) return 0;
 
-	PUGI_IMPL_FN xpath_node::xpath_node(const xml_node& node_): _node(node_)
-	{
-	}
+			auto_deleter<void> guard(memory, xml_memory::deallocate);
 
-	PUGI_IMPL_FN xpath_node::xpath_node(const xml_attribute& attribute_, const xml_node& parent_): _node(attribute_ ? parent_ : xml_node()), _attribute(attribute_)
-	{
-	}
+			xpath_query_cache_entry* result = new (memory) xpath_query_cache_entry(text);
+			memcpy(result->text, text, (length + 1) * sizeof(char_t));
 
-	PUGI_IMPL_FN xml_node xpath_node::node() const
-	{
-		return _attribute ? xml_node() : _node;
-	}
+			guard.release();
 
-	PUGI_IMPL_FN xml_attribute xpath_node::attribute() const
-	{
-		return _attribute;
-	}
+			return result;
+		}
 
-	PUGI_IMPL_FN xml_node xpath_node::parent() const
-	{
-		return _attribute ? _node : _node.parent();
-	}
+		static void destroy(xpath_query_cache_entry* entry)
+		{
+			entry->~xpath_query_cache_entry();
+			xml_memory::deallocate(entry);
+		}
 
-	PUGI_IMPL_FN static void unspecified_bool_xpath_node(xpath_node***)
-	{
-	}
+	private:
+		explicit xpath_query_cache_entry(const char_t* text_): next(0), query(text_)
+		{
+		}
+	};
 
-	PUGI_IMPL_FN xpath_node::operator xpath_node::unspecified_bool_type() const
+	template <typename T>
+	struct xpath_query_cache_storage
 	{
-		return (_node || _attribute) ? unspecified_bool_xpath_node : 0;
-	}
+		static std::atomic<xpath_query_cache_entry*> buckets[256];
+		static std::atomic<size_t> size;
+		static std::mutex mutex;
+	};
 
-	PUGI_IMPL_FN bool xpath_node::operator!() const
-	{
-		return !(_node || _attribute);
-	}
+	// Same as xml_memory: class statics let the linker deduplicate the cache in header mode
+	template <typename T> std::atomic<xpath_query_cache_entry*> xpath_query_cache_storage<T>::buckets[256];
+	template <typename T> std::atomic<size_t> xpath_query_cache_storage<T>::size;
+	template <typename T> std::mutex xpath_query_cache_storage<T>::mutex;
 
-	PUGI_IMPL_FN bool xpath_node::operator==(const xpath_node& n) const
+	typedef xpath_query_cache_storage<int> xpath_query_cache_data;
+
+	PUGI_IMPL_FN xpath_query_cache_entry* xpath_query_cache_find(xpath_query_cache_entry* chain, const char_t* query)
 	{
-		return _node == n._node && _attribute == n._attribute;
+		for (xpath_query_cache_entry* entry = chain; entry; entry = entry->next)
+			if (strequal(entry->text, query))
+				return entry;
+
+		return 0;
 	}
 
-	PUGI_IMPL_FN bool xpath_node::operator!=(const xpath_node& n) const
+	struct xpath_batch_evaluator
+	{
+		xpath_ast_node* root;
+		const xpath_node* contexts;
+		xpath_node_set* results;
+		size_t count;
+
+		std::atomic<size_t> next;
+		std::atomic<bool> failed;
+		bool oom;
+
+	#ifndef PUGIXML_NO_EXCEPTIONS
+		std::exception_ptr exception;
+		std::mutex exception_mutex;
+	#endif
+
+		xpath_batch_evaluator(xpath_ast_node* root_, const xpath_node* contexts_, xpath_node_set* results_, size_t count_): root(root_), contexts(contexts_), results(results_), count(count_), next(0), failed(false), oom(false)
+		{
+		}
+
+		void run()
+		{
+		#ifndef PUGIXML_NO_EXCEPTIONS
+			try
+			{
+				run_contexts();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(exception_mutex);
+				if (!exception) exception = std::current_exception();
+
+				failed = true;
+			}
+		#else
+			run_contexts();
+		#endif
+		}
+
+		void run_contexts()
+		{
+			// the stack is reused for all contexts processed by this thread; allocations are reverted after every context
+			xpath_stack_data sd;
+
+			while (!failed.load(std::memory_order_relaxed))
+			{
+				size_t index = next.fetch_add(1, std::memory_order_relaxed);
+				if (index >= count) break;
+
+				xpath_allocator_capture cr(&sd.result);
+				xpath_allocator_capture ct(&sd.temp);
+
+				xpath_context c(contexts[index], 1, 1);
+				xpath_node_set_raw r = root->eval_node_set(c, sd.stack, nodeset_eval_all);
+
+				if (sd.oom)
+				{
+					// oom is only read after all threads are joined
+					oom = true;
+					failed = true;
+					break;
+				}
+
+				results[index] = xpath_node_set(r.begin(), r.end(), r.type());
+			}
+		}
+	};
+
+	PUGI_IMPL_FN void xpath_batch_evaluator_run(xpath_batch_evaluator* evaluator)
+	{
+		evaluator->run();
+	}
+#endif
+
+#ifdef PUGIXML_HAS_XPATH_STREAM
+	// Active steps of a streaming query are tracked as a bit mask per open element
+	static const size_t xpath_stream_max_steps = 32;
+
+	static const size_t xpath_stream_buffer_size = 65536;
+
+	enum xpath_stream_target_t
+	{
+		xpath_stream_target_element,
+		xpath_stream_target_attribute,
+		xpath_stream_target_text
+	};
+
+	struct xpath_stream_step
+	{
+		const char_t* name; // 0 for wildcard
+		size_t name_length;
+		bool descendant; // step can match elements at any depth below the previous match
+		bool self; // step can also match the element that matched the previous step
+
+		xpath_query* predicate;
+		const char_t* predicate_begin;
+		const char_t* predicate_end;
+	};
+
+	struct xpath_stream_query_impl
+	{
+		xpath_stream_step steps[xpath_stream_max_steps];
+		size_t step_count;
+
+		xpath_stream_target_t target;
+		const char_t* target_name; // attribute name, 0 for wildcard
+		size_t target_name_length;
+
+		// copy of the query text; step names point into it
+		char_t text[1];
+
+		static xpath_stream_query_impl* create(const char_t* query)
+		{
+			size_t length = strlength(query);
+
+			void* memory = xml_memory::allocate(sizeof(xpath_stream_query_impl) + length * sizeof(char_t));
+			if (!memory) return 0;
+
+			xpath_stream_query_impl* result = new (memory) xpath_stream_query_impl();
+			memcpy(result->text, query, (length + 1) * sizeof(char_t));
+
+			return result;
+		}
+
+		static void destroy(xpath_stream_query_impl* impl)
+		{
+			for (size_t i = 0; i < impl->step_count; ++i)
+			{
+				xpath_query* predicate = impl->steps[i].predicate;
+
+				if (predicate)
+				{
+					predicate->~xpath_query();
+					xml_memory::deallocate(predicate);
+				}
+			}
+
+			xml_memory::deallocate(impl);
+		}
+
+		xpath_stream_query_impl(): step_count(0), target(xpath_stream_target_element), target_name(0), target_name_length(0)
+		{
+		}
+
+		static bool name_test(const char_t* test, size_t test_length, const char_t* name, size_t name_length)
+		{
+			if (!test) return true;
+
+			// ns:* matches all names with the given prefix
+			if (test_length >= 2 && test[test_length - 1] == '*' && test[test_length - 2] == ':')
+				return name_length >= test_length - 1 && memcmp(test, name, (test_length - 1) * sizeof(char_t)) == 0;
+
+			return test_length == name_length && memcmp(test, name, name_length * sizeof(char_t)) == 0;
+		}
+
+		// Test the element against the step and activate the following steps on success
+		void advance(size_t step, const char_t* name, size_t name_length, const xml_node* element, unsigned int& state, bool& matched) const
+		{
+			for (; step < step_count; ++step)
+			{
+				if (!name_test(steps[step].name, steps[step].name_length, name, name_length)) return;
+
+				if (steps[step].predicate)
+				{
+					// predicates need the element subtree; report the element as a match so that the caller parses it
+					if (!element)
+					{
+						matched = true;
+						return;
+					}
+
+					if (!steps[step].predicate->evaluate_boolean(*element)) return;
+				}
+
+				if (step + 1 == step_count)
+				{
+					matched = true;
+					return;
+				}
+
+				state |= 1u << (step + 1);
+
+				if (!steps[step + 1].self) return;
+			}
+		}
+
+		// Compute the steps that are active for children of an element, given the steps that are active for the element's parent.
+		// When element is null (element is not parsed yet), matched is also set for elements that need a predicate evaluated.
+		unsigned int enter(unsigned int parent_state, const char_t* name, size_t name_length, const xml_node* element, bool& matched) const
+		{
+			unsigned int state = 0;
+			matched = false;
+
+			for (size_t step = 0; step < step_count; ++step)
+			{
+				if ((parent_state & (1u << step)) == 0) continue;
+
+				if (steps[step].descendant) state |= 1u << step;
+
+				advance(step, name, name_length, element, state, matched);
+			}
+
+			return state;
+		}
+
+		bool add_step(const char_t* name, size_t name_length, bool descendant, bool self)
+		{
+			if (step_count == xpath_stream_max_steps) return false;
+
+			xpath_stream_step& step = steps[step_count++];
+
+			step.name = name;
+			step.name_length = name_length;
+			step.descendant = descendant;
+			step.self = self;
+			step.predicate = 0;
+			step.predicate_begin = 0;
+			step.predicate_end = 0;
+
+			return true;
+		}
+	};
+
+	// Parse the query into element steps using the regular XPath lexer; returns error message or 0
+	PUGI_IMPL_FN const char* xpath_stream_parse(xpath_stream_query_impl* impl, const char_t** out_position)
+	{
+		enum stream_axis_t { stream_axis_child, stream_axis_descendant, stream_axis_descendant_or_self, stream_axis_attribute };
+
+		xpath_lexer lexer(impl->text);
+		*out_position = lexer.current_pos();
+
+		if (lexer.current() != lex_slash && lexer.current() != lex_double_slash)
+			return "Streaming queries must be absolute location paths";
+
+		while (lexer.current() == lex_slash || lexer.current() == lex_double_slash)
+		{
+			bool double_slash = lexer.current() == lex_double_slash;
+
+			lexer.next();
+			*out_position = lexer.current_pos();
+
+			if (impl->target != xpath_stream_target_element)
+				return "Attribute and text() steps must be the last step of a streaming query";
+
+			stream_axis_t axis = stream_axis_child;
+
+			if (lexer.current() == lex_axis_attribute)
+			{
+				axis = stream_axis_attribute;
+				lexer.next();
+			}
+			else if (lexer.current() == lex_string)
+			{
+				xpath_lexer lookahead = lexer;
+				lookahead.next();
+
+				if (lookahead.current() == lex_double_colon)
+				{
+					const xpath_lexer_string& name = lexer.contents();
+
+					if (name == PUGIXML_TEXT("child"))
+						axis = stream_axis_child;
+					else if (name == PUGIXML_TEXT("descendant"))
+						axis = stream_axis_descendant;
+					else if (name == PUGIXML_TEXT("descendant-or-self"))
+						axis = stream_axis_descendant_or_self;
+					else if (name == PUGIXML_TEXT("attribute"))
+						axis = stream_axis_attribute;
+					else
+						return "Only child, descendant, descendant-or-self and attribute axes are supported in streaming queries";
+
+					lexer = lookahead;
+					lexer.next();
+				}
+			}
+
+			const char_t* name = 0;
+			size_t name_length = 0;
+			bool text_test = false;
+
+			if (lexer.current() == lex_multiply)
+			{
+				lexer.next();
+			}
+			else if (lexer.current() == lex_string)
+			{
+				xpath_lexer_string contents = lexer.contents();
+				lexer.next();
+
+				if (lexer.current() == lex_open_brace)
+				{
+					if (!(contents == PUGIXML_TEXT("text")) || axis == stream_axis_attribute)
+						return "Only text() node type test is supported in streaming queries";
+
+					lexer.next();
+
+					if (lexer.current() != lex_close_brace)
+						return "Unmatched brace near node type test";
+
+					lexer.next();
+
+					text_test = true;
+				}
+				else
+				{
+					name = contents.begin;
+					name_length = static_cast<size_t>(contents.end - contents.begin);
+				}
+			}
+			else
+				return "Unrecognized node test";
+
+			if (axis == stream_axis_attribute || text_test)
+			{
+				// //@a and //text() select attributes/text of the previous match and of all elements below it
+				if (double_slash || axis == stream_axis_descendant || axis == stream_axis_descendant_or_self)
+					if (!impl->add_step(0, 0, true, true)) return "Too many steps in streaming query";
+
+				impl->target = text_test ? xpath_stream_target_text : xpath_stream_target_attribute;
+				impl->target_name = name;
+				impl->target_name_length = name_length;
+			}
+			else
+			{
+				if (!impl->add_step(name, name_length, double_slash || axis != stream_axis_child, axis == stream_axis_descendant_or_self))
+					return "Too many steps in streaming query";
+			}
+
+			if (lexer.current() == lex_open_square_brace)
+			{
+				if (impl->target != xpath_stream_target_element)
+					return "Predicates are only supported on element steps of a streaming query";
+
+				xpath_stream_step& step = impl->steps[impl->step_count - 1];
+
+				step.predicate_begin = lexer.state();
+
+				for (size_t depth = 1; depth > 0; )
+				{
+					lexer.next();
+
+					if (lexer.current() == lex_eof) return "Unmatched square brace";
+					if (lexer.current() == lex_none) return "Unrecognized token";
+
+					if (lexer.current() == lex_open_square_brace) depth++;
+					else if (lexer.current() == lex_close_square_brace) depth--;
+				}
+
+				step.predicate_end = lexer.current_pos();
+				lexer.next();
+
+				if (lexer.current() == lex_open_square_brace)
+					return "Only one predicate per step is supported in streaming queries";
+			}
+		}
+
+		*out_position = lexer.current_pos();
+
+		if (lexer.current() != lex_eof)
+			return "Incorrect query";
+
+		if (impl->step_count == 0)
+			return "Streaming queries must contain at least one element step";
+
+		// predicates are compiled as separate queries, so terminate them in our copy of the query
+		for (size_t i = 0; i < impl->step_count; ++i)
+			if (impl->steps[i].predicate_end)
+				impl->text[impl->steps[i].predicate_end - impl->text] = 0;
+
+		return 0;
+	}
+
+	typedef size_t (*xpath_stream_read_function)(void* context, void* data, size_t size, bool* error);
+
+	PUGI_IMPL_FN size_t xpath_stream_read_file(void* context, void* data, size_t size, bool* error)
+	{
+		FILE* file = static_cast<FILE*>(context);
+
+		size_t result = fread(data, 1, size, file);
+		if (result == 0 && ferror(file)) *error = true;
+
+		return result;
+	}
+
+	struct xpath_stream_memory
+	{
+		const char* data;
+		size_t size;
+	};
+
+	PUGI_IMPL_FN size_t xpath_stream_read_memory(void* context, void* data, size_t size, bool*)
+	{
+		xpath_stream_memory* memory = static_cast<xpath_stream_memory*>(context);
+
+		size_t result = size < memory->size ? size : memory->size;
+
+		memcpy(data, memory->data, result);
+		memory->data += result;
+		memory->size -= result;
+
+		return result;
+	}
+
+#ifndef PUGIXML_NO_STL
+	PUGI_IMPL_FN size_t xpath_stream_read_stream(void* context, void* data, size_t size, bool* error)
+	{
+		std::basic_istream<char>* stream = static_cast<std::basic_istream<char>*>(context);
+
+		stream->read(static_cast<char*>(data), static_cast<std::streamsize>(size));
+
+		size_t result = static_cast<size_t>(stream->gcount());
+		if (result == 0 && (stream->bad() || (stream->fail() && !stream->eof()))) *error = true;
+
+		return result;
+	}
+#endif
+
+	PUGI_IMPL_FN bool xpath_stream_reserve(void** data, size_t* capacity, size_t required, size_t element_size)
+	{
+		if (required <= *capacity) return true;
+
+		size_t new_capacity = *capacity ? *capacity * 2 : 64;
+		if (new_capacity < required) new_capacity = required;
+
+		void* result = xml_memory::allocate(new_capacity * element_size);
+		if (!result) return false;
+
+		if (*data)
+		{
+			memcpy(result, *data, *capacity * element_size);
+			xml_memory::deallocate(*data);
+		}
+
+		*data = result;
+		*capacity = new_capacity;
+
+		return true;
+	}
+
+	struct xpath_stream_element
+	{
+		size_t name_offset;
+		size_t name_length;
+		unsigned int state;
+	};
+
+	struct xpath_stream_walk_entry
+	{
+		unsigned int state;
+		bool matched;
+	};
+
+	// Tokenizes the input without building a tree; subtrees of matching elements are kept in the buffer and parsed with xml_parser
+	struct xpath_stream_parser
+	{
+		const xpath_stream_query_impl* query;
+		xpath_stream_handler* handler;
+		unsigned int options;
+
+		xpath_stream_read_function read;
+		void* read_context;
+		bool read_error;
+		bool eof;
+
+		char* data;
+		size_t size;
+		size_t capacity;
+		size_t pos;
+		size_t discarded; // bytes of input that were removed from the front of the buffer
+
+		xpath_stream_element* stack;
+		size_t depth;
+		size_t stack_capacity;
+
+		char* names;
+		size_t names_size;
+		size_t names_capacity;
+
+		xpath_stream_walk_entry* walk_stack;
+		size_t walk_capacity;
+
+		size_t match_depth; // depth of the matching element plus one; 0 outside of matching subtrees
+		size_t match_start;
+		unsigned int match_state; // steps active for the parent of the matching element
+
+		bool has_element;
+		bool stopped;
+
+		xml_parse_status error_status;
+		ptrdiff_t error_offset;
+
+		xml_document document;
+
+		xpath_stream_parser(const xpath_stream_query_impl* query_, xpath_stream_handler* handler_, unsigned int options_, xpath_stream_read_function read_, void* read_context_):
+			query(query_), handler(handler_), options(options_), read(read_), read_context(read_context_), read_error(false), eof(false),
+			data(0), size(0), capacity(0), pos(0), discarded(0), stack(0), depth(0), stack_capacity(0), names(0), names_size(0), names_capacity(0),
+			walk_stack(0), walk_capacity(0), match_depth(0), match_start(0), match_state(0), has_element(false), stopped(false), error_status(status_ok), error_offset(0)
+		{
+		}
+
+		~xpath_stream_parser()
+		{
+			if (data) xml_memory::deallocate(data);
+			if (stack) xml_memory::deallocate(stack);
+			if (names) xml_memory::deallocate(names);
+			if (walk_stack) xml_memory::deallocate(walk_stack);
+		}
+
+		xml_parse_status error(xml_parse_status status)
+		{
+			error_status = status;
+			error_offset = static_cast<ptrdiff_t>(discarded + pos);
+
+			return status;
+		}
+
+		bool refill()
+		{
+			if (eof) return false;
+
+			// everything before the current position is consumed, unless it belongs to the subtree being matched
+			size_t keep = match_depth ? match_start : pos;
+
+			if (keep)
+			{
+				memmove(data, data + keep, size - keep);
+
+				size -= keep;
+				pos -= keep;
+				discarded += keep;
+
+				if (match_depth) match_start -= keep;
+			}
+
+			if (size == capacity)
+			{
+				void* buffer = data;
+
+				if (!xpath_stream_reserve(&buffer, &capacity, capacity ? capacity * 2 : xpath_stream_buffer_size, 1))
+				{
+					eof = true;
+					error_status = status_out_of_memory;
+					return false;
+				}
+
+				data = static_cast<char*>(buffer);
+			}
+
+			size_t read_size = read(read_context, data + size, capacity - size, &read_error);
+
+			if (read_size == 0)
+			{
+				eof = true;
+				return false;
+			}
+
+			size += read_size;
+
+			return true;
+		}
+
+		bool available(size_t count)
+		{
+			while (size - pos < count)
+				if (!refill()) return false;
+
+			return true;
+		}
+
+		// Find character at or after pos + offset; returns offset relative to pos
+		bool find(char ch, size_t offset, size_t& result)
+		{
+			for (;;)
+			{
+				if (pos + offset < size)
+				{
+					const void* found = memchr(data + pos + offset, ch, size - pos - offset);
+
+					if (found)
+					{
+						result = static_cast<size_t>(static_cast<const char*>(found) - (data + pos));
+						return true;
+					}
+
+					offset = size - pos;
+				}
+
+				if (!refill()) return false;
+			}
+		}
+
+		// Move pos past the terminator that is found at or after pos + offset
+		bool skip_past(const char* terminator, size_t length, size_t offset)
+		{
+			for (;;)
+			{
+				size_t found;
+				if (!find(terminator[0], offset, found) || !available(found + length)) return false;
+
+				if (memcmp(data + pos + found, terminator, length) == 0)
+				{
+					pos += found + length;
+					return true;
+				}
+
+				offset = found + 1;
+			}
+		}
+
+		bool skip_doctype()
+		{
+			// internal subset can contain markup declarations with '>' inside of them
+			size_t bracket_depth = 0;
+			char quote = 0;
+
+			for (size_t i = 2; available(i + 1); ++i)
+			{
+				char ch = data[pos + i];
+
+				if (quote)
+				{
+					if (ch == quote) quote = 0;
+				}
+				else if (ch == '"' || ch == '\'') quote = ch;
+				else if (ch == '[') bracket_depth++;
+				else if (ch == ']' && bracket_depth) bracket_depth--;
+				else if (ch == '>' && bracket_depth == 0)
+				{
+					pos += i + 1;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		bool push(const char* name, size_t name_length, unsigned int state)
+		{
+			void* buffer = stack;
+			if (!xpath_stream_reserve(&buffer, &stack_capacity, depth + 1, sizeof(xpath_stream_element))) return false;
+			stack = static_cast<xpath_stream_element*>(buffer);
+
+			buffer = names;
+			if (!xpath_stream_reserve(&buffer, &names_capacity, names_size + name_length, 1)) return false;
+			names = static_cast<char*>(buffer);
+
+			xpath_stream_element& element = stack[depth++];
+
+			element.name_offset = names_size;
+			element.name_length = name_length;
+			element.state = state;
+
+			memcpy(names + names_size, name, name_length);
+			names_size += name_length;
+
+			return true;
+		}
+
+		xml_parse_status parse_start_tag()
+		{
+			// pos points to '<'
+			size_t i = 1;
+
+			while (available(i + 1) && !PUGI_IMPL_IS_CHARTYPE(data[pos + i], ct_space) && data[pos + i] != '/' && data[pos + i] != '>') ++i;
+
+			size_t name_length = i - 1;
+			if (name_length == 0) return error(status_unrecognized_tag);
+
+			char quote = 0;
+
+			for (;; ++i)
+			{
+				if (!available(i + 1)) return error(status_bad_start_element);
+
+				char ch = data[pos + i];
+
+				if (quote)
+				{
+					if (ch == quote) quote = 0;
+				}
+				else if (ch == '"' || ch == '\'') quote = ch;
+				else if (ch == '>') break;
+			}
+
+			bool self_closing = data[pos + i - 1] == '/' && i - 1 > name_length;
+			size_t end = pos + i + 1;
+
+			has_element = true;
+
+			bool matched = false;
+			unsigned int state = 0;
+
+			if (match_depth == 0)
+			{
+				unsigned int parent_state = depth ? stack[depth - 1].state : 1;
+
+				state = query->enter(parent_state, data + pos + 1, name_length, 0, matched);
+
+				if (matched)
+				{
+					match_start = pos;
+					match_depth = depth + 1;
+					match_state = parent_state;
+				}
+			}
+
+			if (!self_closing && !push(data + pos + 1, name_length, state))
+				return error(status_out_of_memory);
+
+			pos = end;
+
+			return matched && self_closing ? finish_match(end) : status_ok;
+		}
+
+		xml_parse_status parse_end_tag()
+		{
+			// pos points to "</"
+			size_t i = 2;
+
+			while (available(i + 1) && !PUGI_IMPL_IS_CHARTYPE(data[pos + i], ct_space) && data[pos + i] != '>') ++i;
+
+			size_t name_length = i - 2;
+
+			while (available(i + 1) && PUGI_IMPL_IS_CHARTYPE(data[pos + i], ct_space)) ++i;
+
+			if (!available(i + 1) || data[pos + i] != '>') return error(status_bad_end_element);
+
+			if (depth == 0) return error(status_end_element_mismatch);
+
+			const xpath_stream_element& element = stack[depth - 1];
+
+			if (element.name_length != name_length || memcmp(names + element.name_offset, data + pos + 2, name_length) != 0)
+				return error(status_end_element_mismatch);
+
+			names_size = element.name_offset;
+			depth--;
+
+			size_t end = pos + i + 1;
+			pos = end;
+
+			return match_depth == depth + 1 ? finish_match(end) : status_ok;
+		}
+
+		xml_parse_status finish_match(size_t end)
+		{
+			size_t start = match_start;
+			unsigned int state = match_state;
+
+			match_depth = 0;
+
+			xml_parse_result result = document.load_buffer_inplace(data + start, end - start, options, encoding_utf8);
+
+			if (!result)
+			{
+				error_status = result.status;
+				error_offset = static_cast<ptrdiff_t>(discarded + start) + result.offset;
+
+				return error_status;
+			}
+
+			if (!walk(document.document_element(), state)) stopped = true;
+
+			return status_ok;
+		}
+
+		bool report(const xml_node& element)
+		{
+			switch (query->target)
+			{
+			case xpath_stream_target_element:
+				return handler->match(element);
+
+			case xpath_stream_target_attribute:
+				for (xml_attribute a = element.first_attribute(); a; a = a.next_attribute())
+					if (xpath_stream_query_impl::name_test(query->target_name, query->target_name_length, a.name(), strlength(a.name())))
+						if (!handler->match(xpath_node(a, element))) return false;
+
+				return true;
+
+			default:
+				// text nodes are reported while walking the children
+				return true;
+			}
+		}
+
+		// Report matches in a parsed subtree, given the steps that are active for the parent of the subtree root
+		bool walk(const xml_node& root, unsigned int parent_state)
+		{
+			bool root_matched = false;
+			unsigned int state = query->enter(parent_state, root.name(), strlength(root.name()), &root, root_matched);
+
+			if (root_matched && !report(root)) return false;
+
+			void* buffer = walk_stack;
+			if (!xpath_stream_reserve(&buffer, &walk_capacity, 1, sizeof(xpath_stream_walk_entry))) return false;
+			walk_stack = static_cast<xpath_stream_walk_entry*>(buffer);
+
+			walk_stack[0].state = state;
+			walk_stack[0].matched = root_matched;
+
+			size_t top = 1;
+			xml_node cur = root.first_child();
+
+			while (cur)
+			{
+				const xpath_stream_walk_entry& parent = walk_stack[top - 1];
+
+				if (cur.type() == node_element)
+				{
+					bool matched = false;
+					unsigned int child_state = parent.state ? query->enter(parent.state, cur.name(), strlength(cur.name()), &cur, matched) : 0;
+
+					if (matched && !report(cur)) return false;
+
+					if (cur.first_child() && (child_state || (matched && query->target == xpath_stream_target_text)))
+					{
+						buffer = walk_stack;
+						if (!xpath_stream_reserve(&buffer, &walk_capacity, top + 1, sizeof(xpath_stream_walk_entry))) return false;
+						walk_stack = static_cast<xpath_stream_walk_entry*>(buffer);
+
+						walk_stack[top].state = child_state;
+						walk_stack[top].matched = matched;
+						top++;
+
+						cur = cur.first_child();
+						continue;
+					}
+				}
+				else if ((cur.type() == node_pcdata || cur.type() == node_cdata) && parent.matched && query->target == xpath_stream_target_text)
+				{
+					if (!handler->match(cur)) return false;
+				}
+
+				while (!cur.next_sibling())
+				{
+					cur = cur.parent();
+					if (--top == 0) return true;
+				}
+
+				cur = cur.next_sibling();
+			}
+
+			return true;
+		}
+
+		xml_parse_status parse()
+		{
+			// XML without a BOM starts with '<' or whitespace, so a zero byte at the start means UTF-16/UTF-32
+			if (available(2) && (data[0] == 0 || data[1] == 0 || (static_cast<unsigned char>(data[0]) == 0xfe && static_cast<unsigned char>(data[1]) == 0xff) || (static_cast<unsigned char>(data[0]) == 0xff && static_cast<unsigned char>(data[1]) == 0xfe)))
+				return error(status_io_error);
+
+			if (available(3) && static_cast<unsigned char>(data[0]) == 0xef && static_cast<unsigned char>(data[1]) == 0xbb && static_cast<unsigned char>(data[2]) == 0xbf)
+				pos += 3;
+
+			while (!stopped)
+			{
+				size_t offset;
+				if (!find('<', 0, offset)) break;
+
+				pos += offset;
+
+				if (!available(2)) return error(status_unrecognized_tag);
+
+				xml_parse_status status = status_ok;
+
+				if (data[pos + 1] == '?')
+				{
+					if (!skip_past("?>", 2, 2)) return error(status_bad_pi);
+				}
+				else if (data[pos + 1] == '!')
+				{
+					if (available(4) && data[pos + 2] == '-' && data[pos + 3] == '-')
+					{
+						if (!skip_past("-->", 3, 4)) return error(status_bad_comment);
+					}
+					else if (available(9) && memcmp(data + pos + 2, "[CDATA[", 7) == 0)
+					{
+						if (!skip_past("]]>", 3, 9)) return error(status_bad_cdata);
+					}
+					else if (!skip_doctype()) return error(status_bad_doctype);
+				}
+				else if (data[pos + 1] == '/')
+					status = parse_end_tag();
+				else
+					status = parse_start_tag();
+
+				if (status != status_ok) return status;
+			}
+
+			if (error_status != status_ok) return error_status;
+			if (read_error) return error(status_io_error);
+
+			if (stopped) return status_ok;
+
+			if (depth) return error(status_end_element_mismatch);
+
+			if (!has_element && !(options & parse_fragment)) return error(status_no_document_element);
+
+			return status_ok;
+		}
+	};
+
+	PUGI_IMPL_FN xml_parse_result xpath_stream_evaluate(const xpath_stream_query_impl* query, xpath_stream_read_function read, void* read_context, xpath_stream_handler& handler, unsigned int options)
+	{
+		if (!query) return make_parse_result(status_internal_error);
+
+		xpath_stream_parser parser(query, &handler, options, read, read_context);
+
+		xml_parse_status status = parser.parse();
+
+		xml_parse_result result = make_parse_result(status, status == status_ok ? 0 : parser.error_offset);
+		result.encoding = encoding_utf8;
+
+		return result;
+	}
+#endif
+PUGI_IMPL_NS_END
+
+namespace pugi
+{
+#ifndef PUGIXML_NO_EXCEPTIONS
+	PUGI_IMPL_FN xpath_exception::xpath_exception(const xpath_parse_result& result_): _result(result_)
+	{
+		assert(_result.error);
+	}
+
+	PUGI_IMPL_FN const char* xpath_exception::what() const throw()
+	{
+		return _result.error;
+	}
+
+	PUGI_IMPL_FN const xpath_parse_result& xpath_exception::result() const
+	{
+		return _result;
+	}
+#endif
+
+	PUGI_IMPL_FN xpath_node::xpath_node()
+	{
+	}
+
+	PUGI_IMPL_FN xpath_node::xpath_node(const xml_node& node_): _node(node_)
+	{
+	}
+
+	PUGI_IMPL_FN xpath_node::xpath_node(const xml_attribute& attribute_, const xml_node& parent_): _node(attribute_ ? parent_ : xml_node()), _attribute(attribute_)
 	{
-		return _node != n._node || _attribute != n._attribute;
+	}
+
+	PUGI_IMPL_FN xml_node xpath_node::node() const
+	{
+		return _attribute ? xml_node() : _node;
+	}
+
+	PUGI_IMPL_FN xml_attribute xpath_node::attribute() const
+	{
+		return _attribute;
+	}
+
+	PUGI_IMPL_FN xml_node xpath_node::parent() const
+	{
+		return _attribute ? _node : _node.parent();
+	}
+
+	PUGI_IMPL_FN static void unspecified_bool_xpath_node(xpath_node***)
+	{
+	}
+
+	PUGI_IMPL_FN xpath_node::operator xpath_node::unspecified_bool_type() const
+	{
+		return (_node || _attribute) ? unspecified_bool_xpath_node : 0;
+	}
+
+	PUGI_IMPL_FN bool xpath_node::operator!() const
+	{
+		return !(_node || _attribute);
+	}
+
+	PUGI_IMPL_FN bool xpath_node::operator==(const xpath_node& n) const
+	{
+		return _node == n._node && _attribute == n._attribute;
+	}
+
+	PUGI_IMPL_FN bool xpath_node::operator!=(const xpath_node& n) const
+	{
+		return _node != n._node || _attribute != n._attribute;
 	}
 
 #ifdef __BORLANDC__
@@ -13098,6 +14451,62 @@ namespace pugi
 		return r.first();
 	}
 
+#ifdef PUGIXML_HAS_XPATH_CACHE
+	PUGI_IMPL_FN void xpath_query::evaluate_node_sets(const xpath_node* contexts, size_t count, xpath_node_set* results, unsigned int thread_count) const
+	{
+		impl::xpath_ast_node* root = impl::evaluate_node_set_prepare(static_cast<impl::xpath_query_impl*>(_impl));
+
+		if (!root)
+		{
+			for (size_t i = 0; i < count; ++i)
+				results[i] = xpath_node_set();
+
+			return;
+		}
+
+		if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+		if (thread_count == 0) thread_count = 1;
+		if (thread_count > count) thread_count = static_cast<unsigned int>(count);
+
+		impl::xpath_batch_evaluator evaluator(root, contexts, results, count);
+
+		std::vector<std::thread> workers;
+
+	#ifndef PUGIXML_NO_EXCEPTIONS
+		try
+		{
+			for (unsigned int i = 1; i < thread_count; ++i)
+				workers.push_back(std::thread(impl::xpath_batch_evaluator_run, &evaluator));
+		}
+		catch (...)
+		{
+			// failing to spawn a thread is not fatal; the remaining contexts are picked up by the threads we have
+		}
+	#else
+		workers.reserve(thread_count);
+
+		for (unsigned int i = 1; i < thread_count; ++i)
+			workers.push_back(std::thread(impl::xpath_batch_evaluator_run, &evaluator));
+	#endif
+
+		evaluator.run();
+
+		for (size_t i = 0; i < workers.size(); ++i)
+			workers[i].join();
+
+		if (evaluator.failed)
+		{
+		#ifdef PUGIXML_NO_EXCEPTIONS
+			for (size_t i = 0; i < count; ++i)
+				results[i] = xpath_node_set();
+		#else
+			if (evaluator.exception) std::rethrow_exception(evaluator.exception);
+			if (evaluator.oom) throw std::bad_alloc();
+		#endif
+		}
+	}
+#endif
+
 	PUGI_IMPL_FN const xpath_parse_result& xpath_query::result() const
 	{
 		return _result;
@@ -13117,8 +14526,214 @@ namespace pugi
 		return !_impl;
 	}
 
+#ifdef PUGIXML_HAS_XPATH_CACHE
+	PUGI_IMPL_FN const xpath_query* xpath_query_cache::get(const char_t* query)
+	{
+		typedef impl::xpath_query_cache_data data;
+
+		const size_t hash_size = sizeof(data::buckets) / sizeof(data::buckets[0]);
+		std::atomic<impl::xpath_query_cache_entry*>& bucket = data::buckets[impl::hash_string(query) % hash_size];
+
+		// entries are never removed outside of clear(), so readers only need to see fully constructed chain heads
+		impl::xpath_query_cache_entry* entry = impl::xpath_query_cache_find(bucket.load(std::memory_order_acquire), query);
+		if (entry) return &entry->query;
+
+		if (data::size.load(std::memory_order_relaxed) >= impl::xpath_query_cache_capacity) return 0;
+
+		// compile outside of the lock so that misses on different queries do not serialize
+		impl::xpath_query_cache_entry* result = impl::xpath_query_cache_entry::create(query);
+
+		if (!result)
+		{
+		#ifdef PUGIXML_NO_EXCEPTIONS
+			return 0;
+		#else
+			throw std::bad_alloc();
+		#endif
+		}
+
+		std::lock_guard<std::mutex> lock(data::mutex);
+
+		// another thread may have compiled the same query while we were compiling ours
+		entry = impl::xpath_query_cache_find(bucket.load(std::memory_order_relaxed), query);
+
+		if (entry || data::size.load(std::memory_order_relaxed) >= impl::xpath_query_cache_capacity)
+		{
+			impl::xpath_query_cache_entry::destroy(result);
+
+			return entry ? &entry->query : 0;
+		}
+
+		result->next = bucket.load(std::memory_order_relaxed);
+		bucket.store(result, std::memory_order_release);
+		data::size.fetch_add(1, std::memory_order_relaxed);
+
+		return &result->query;
+	}
+
+	PUGI_IMPL_FN size_t xpath_query_cache::size()
+	{
+		return impl::xpath_query_cache_data::size.load(std::memory_order_relaxed);
+	}
+
+	PUGI_IMPL_FN void xpath_query_cache::clear()
+	{
+		typedef impl::xpath_query_cache_data data;
+
+		std::lock_guard<std::mutex> lock(data::mutex);
+
+		for (size_t i = 0; i < sizeof(data::buckets) / sizeof(data::buckets[0]); ++i)
+		{
+			impl::xpath_query_cache_entry* entry = data::buckets[i].exchange(0, std::memory_order_relaxed);
+
+			while (entry)
+			{
+				impl::xpath_query_cache_entry* next = entry->next;
+
+				impl::xpath_query_cache_entry::destroy(entry);
+
+				entry = next;
+			}
+		}
+
+		data::size.store(0, std::memory_order_relaxed);
+	}
+#endif
+
+#ifdef PUGIXML_HAS_XPATH_STREAM
+	PUGI_IMPL_FN xpath_stream_handler::~xpath_stream_handler()
+	{
+	}
+
+	PUGI_IMPL_FN xpath_stream_query::xpath_stream_query(const char_t* query): _impl(0)
+	{
+		impl::xpath_stream_query_impl* qimpl = impl::xpath_stream_query_impl::create(query);
+
+		if (!qimpl)
+		{
+		#ifdef PUGIXML_NO_EXCEPTIONS
+			_result.error = "Out of memory";
+		#else
+			throw std::bad_alloc();
+		#endif
+		}
+		else
+		{
+			using impl::auto_deleter; // MSVC7 workaround
+			auto_deleter<impl::xpath_stream_query_impl> impl(qimpl, impl::xpath_stream_query_impl::destroy);
+
+			const char_t* position = qimpl->text;
+
+			_result.error = impl::xpath_stream_parse(qimpl, &position);
+			_result.offset = position - qimpl->text;
+
+			for (size_t i = 0; i < qimpl->step_count && !_result.error; ++i)
+			{
+				impl::xpath_stream_step& step = qimpl->steps[i];
+				if (!step.predicate_begin) continue;
+
+				void* memory = impl::xml_memory::allocate(sizeof(xpath_query));
+
+				if (!memory)
+				{
+				#ifdef PUGIXML_NO_EXCEPTIONS
+					_result.error = "Out of memory";
+					return;
+				#else
+					throw std::bad_alloc();
+				#endif
+				}
+
+				auto_deleter<void> memory_guard(memory, impl::xml_memory::deallocate);
+
+				// if the predicate fails to compile, the exception reports the offset within the predicate
+				step.predicate = new (memory) xpath_query(step.predicate_begin);
+				memory_guard.release();
+
+				if (!*step.predicate)
+				{
+					_result.error = step.predicate->result().error;
+					_result.offset = (step.predicate_begin - qimpl->text) + step.predicate->result().offset;
+				}
+				// the predicate only sees the streamed element and its subtree, not its siblings, so position() and last() would be wrong
+				else if (step.predicate->return_type() == xpath_type_number || !static_cast<impl::xpath_query_impl*>(step.predicate->_impl)->root->is_posinv_expr())
+				{
+					_result.error = "Positional predicates are not supported in streaming queries";
+					_result.offset = step.predicate_begin - qimpl->text;
+				}
+			}
+
+			if (!_result.error)
+			{
+				_impl = impl.release();
+			}
+			else
+			{
+			#ifndef PUGIXML_NO_EXCEPTIONS
+				throw xpath_exception(_result);
+			#endif
+			}
+		}
+	}
+
+	PUGI_IMPL_FN xpath_stream_query::~xpath_stream_query()
+	{
+		if (_impl)
+			impl::xpath_stream_query_impl::destroy(static_cast<impl::xpath_stream_query_impl*>(_impl));
+	}
+
+	PUGI_IMPL_FN xml_parse_result xpath_stream_query::evaluate_file(const char* path, xpath_stream_handler& handler, unsigned int options) const
+	{
+		using impl::auto_deleter; // MSVC7 workaround
+		auto_deleter<FILE> file(impl::open_file(path, "rb"), impl::close_file);
+
+		if (!file.data) return impl::make_parse_result(status_file_not_found);
+
+		return impl::xpath_stream_evaluate(static_cast<impl::xpath_stream_query_impl*>(_impl), impl::xpath_stream_read_file, file.data, handler, options);
+	}
+
+	PUGI_IMPL_FN xml_parse_result xpath_stream_query::evaluate_buffer(const void* contents, size_t size, xpath_stream_handler& handler, unsigned int options) const
+	{
+		impl::xpath_stream_memory memory = {static_cast<const char*>(contents), size};
+
+		return impl::xpath_stream_evaluate(static_cast<impl::xpath_stream_query_impl*>(_impl), impl::xpath_stream_read_memory, &memory, handler, options);
+	}
+
+#ifndef PUGIXML_NO_STL
+	PUGI_IMPL_FN xml_parse_result xpath_stream_query::evaluate_stream(std::basic_istream<char, std::char_traits<char> >& stream, xpath_stream_handler& handler, unsigned int options) const
+	{
+		return impl::xpath_stream_evaluate(static_cast<impl::xpath_stream_query_impl*>(_impl), impl::xpath_stream_read_stream, &stream, handler, options);
+	}
+#endif
+
+	PUGI_IMPL_FN const xpath_parse_result& xpath_stream_query::result() const
+	{
+		return _result;
+	}
+
+	PUGI_IMPL_FN static void unspecified_bool_xpath_stream_query(xpath_stream_query***)
+	{
+	}
+
+	PUGI_IMPL_FN xpath_stream_query::operator xpath_stream_query::unspecified_bool_type() const
+	{
+		return _impl ? unspecified_bool_xpath_stream_query : 0;
+	}
+
+	PUGI_IMPL_FN bool xpath_stream_query::operator!() const
+	{
+		return !_impl;
+	}
+#endif
+
 	PUGI_IMPL_FN xpath_node xml_node::select_node(const char_t* query, xpath_variable_set* variables) const
 	{
+	#ifdef PUGIXML_HAS_XPATH_CACHE
+		// queries are bound to their variable set during compilation, so only queries without variables can be shared
+		const xpath_query* cached = variables ? 0 : xpath_query_cache::get(query);
+		if (cached) return cached->evaluate_node(*this);
+	#endif
+
 		xpath_query q(query, variables);
 		return q.evaluate_node(*this);
 	}
@@ -13130,6 +14745,11 @@ namespace pugi
 
 	PUGI_IMPL_FN xpath_node_set xml_node::select_nodes(const char_t* query, xpath_variable_set* variables) const
 	{
+	#ifdef PUGIXML_HAS_XPATH_CACHE
+		const xpath_query* cached = variables ? 0 : xpath_query_cache::get(query);
+		if (cached) return cached->evaluate_node_set(*this);
+	#endif
+
 		xpath_query q(query, variables);
 		return q.evaluate_node_set(*this);
 	}
@@ -13170,11 +14790,14 @@ namespace pugi
 // Undefine all local macros (makes sure we're not leaking macros in header-only mode)
 #undef PUGI_IMPL_NO_INLINE
 #undef PUGI_IMPL_UNLIKELY
+#undef PUGI_IMPL_NO_SANITIZE_ADDRESS
 #undef PUGI_IMPL_STATIC_ASSERT
 #undef PUGI_IMPL_DMC_VOLATILE
 #undef PUGI_IMPL_UNSIGNED_OVERFLOW
 #undef PUGI_IMPL_MSVC_CRT_VERSION
 #undef PUGI_IMPL_SNPRINTF
+#undef PUGI_IMPL_HAS_FROM_CHARS
+#undef PUGI_IMPL_HAS_SSE2
 #undef PUGI_IMPL_NS_BEGIN
 #undef PUGI_IMPL_NS_END
 #undef PUGI_IMPL_FN
@@ -122,6 +122,20 @@
 #	endif
 #endif
 
+// If C++ is 2011 or higher, compile the process-wide XPath query cache and parallel XPath evaluation
+#if !defined(PUGIXML_HAS_XPATH_CACHE) && !defined(PUGIXML_NO_XPATH_CACHE) && !defined(PUGIXML_NO_XPATH) && !defined(PUGIXML_NO_STL)
+#	if __cplusplus >= 201103
+#		define PUGIXML_HAS_XPATH_CACHE
+#	elif defined(_MSC_VER) && _MSC_VER >= 1700
+#		define PUGIXML_HAS_XPATH_CACHE
+#	endif
+#endif
+
+// Streaming XPath evaluation matches raw UTF-8 element names, so it is not available in wchar_t mode
+#if !defined(PUGIXML_HAS_XPATH_STREAM) && !defined(PUGIXML_NO_XPATH) && !defined(PUGIXML_WCHAR_MODE)
+#	define PUGIXML_HAS_XPATH_STREAM
+#endif
+
 // Character interface macros
 #ifdef PUGIXML_WCHAR_MODE
 #	define PUGIXML_TEXT(t) L ## t
@@ -217,6 +231,12 @@ namespace pugi
 	// This flag is off by default.
 	const unsigned int parse_merge_pcdata = 0x4000;
 
+	// This flag makes as_int/as_uint/as_double/as_float/as_llong/as_ullong of nodes and attributes in the document use a locale-independent
+	// std::from_chars conversion for values that are plain decimal numbers; values in other formats use the regular conversion.
+	// Has no effect if the standard library does not provide std::from_chars for floating-point types or in PUGIXML_WCHAR_MODE.
+	// This flag is off by default.
+	const unsigned int parse_fast_numbers = 0x8000;
+
 	// The default parsing mode.
 	// Elements, PCDATA and CDATA sections are added to the DOM tree, character/reference entities are expanded,
 	// End-of-Line characters are normalized, attribute values are normalized using CDATA normalization rules.
@@ -1235,6 +1255,10 @@ namespace pugi
 		xpath_query(const xpath_query&);
 		xpath_query& operator=(const xpath_query&);
 
+	#ifdef PUGIXML_HAS_XPATH_STREAM
+		friend class xpath_stream_query;
+	#endif
+
 	public:
 		// Construct a compiled object from XPath expression.
 		// If PUGIXML_NO_EXCEPTIONS is not defined, throws xpath_exception on compilation errors.
@@ -1280,6 +1304,15 @@ namespace pugi
 		// If PUGIXML_NO_EXCEPTIONS is defined, returns empty node set instead.
 		xpath_node_set evaluate_node_set(const xpath_node& n) const;
 
+	#ifdef PUGIXML_HAS_XPATH_CACHE
+		// Evaluate expression as node set in each of the count contexts; results[i] receives the node set for contexts[i].
+		// Contexts are distributed over up to thread_count threads (0 uses hardware concurrency); each thread reuses one evaluation stack for all its contexts.
+		// Contexts may belong to different documents; the documents must not be modified during evaluation.
+		// If PUGIXML_NO_EXCEPTIONS is not defined, throws xpath_exception on type mismatch and std::bad_alloc on out of memory errors.
+		// If PUGIXML_NO_EXCEPTIONS is defined, fills results with empty node sets instead.
+		void evaluate_node_sets(const xpath_node* contexts, size_t count, xpath_node_set* results, unsigned int thread_count = 0) const;
+	#endif
+
 		// Evaluate expression as node set in the specified context.
 		// Return first node in document order, or empty node if node set is empty.
 		// If PUGIXML_NO_EXCEPTIONS is not defined, throws xpath_exception on type mismatch and std::bad_alloc on out of memory errors.
@@ -1296,6 +1329,83 @@ namespace pugi
 		bool operator!() const;
 	};
 
+#ifdef PUGIXML_HAS_XPATH_CACHE
+	// A process-wide cache of compiled XPath queries, keyed by query text
+	// select_node/select_nodes use it for queries evaluated without a variable set
+	class PUGIXML_CLASS xpath_query_cache
+	{
+	public:
+		// Get compiled query for the expression, compiling it on first use; lookups are lock-free and safe to call from multiple threads.
+		// The query stays valid until clear() is called. Returns null if the cache already holds PUGIXML_XPATH_CACHE_CAPACITY queries.
+		// If PUGIXML_NO_EXCEPTIONS is not defined, throws xpath_exception on compilation errors and std::bad_alloc on out of memory errors.
+		static const xpath_query* get(const char_t* query);
+
+		// Get number of cached queries
+		static size_t size();
+
+		// Destroy all cached queries; must not be called while other threads use the cache or the queries obtained from it
+		static void clear();
+	};
+#endif
+
+#ifdef PUGIXML_HAS_XPATH_STREAM
+	// Callback interface for streaming XPath evaluation (see xpath_stream_query)
+	class PUGIXML_CLASS xpath_stream_handler
+	{
+	public:
+		virtual ~xpath_stream_handler();
+
+		// Called for every matching node in document order; the node and the tree it belongs to are only valid during the call
+		// Return false to stop parsing
+		virtual bool match(const xpath_node& node) = 0;
+	};
+
+	// A compiled XPath query that is evaluated while the document is being parsed, without building the full tree.
+	// Supports absolute location paths of forward (child, descendant, descendant-or-self) element steps with name or wildcard tests,
+	// optionally followed by an attribute or text() step. Element steps may have one non-positional predicate (no number, and no
+	// position() or last() outside nested steps), which is evaluated on the element subtree (the element has no parent or siblings).
+	// Examples: /Kingdom/Road/Time, //Clan[IS_MINE='True']/Name/text()
+	class PUGIXML_CLASS xpath_stream_query
+	{
+	private:
+		void* _impl;
+		xpath_parse_result _result;
+
+		typedef void (*unspecified_bool_type)(xpath_stream_query***);
+
+		// Non-copyable semantics
+		xpath_stream_query(const xpath_stream_query&);
+		xpath_stream_query& operator=(const xpath_stream_query&);
+
+	public:
+		// Construct a compiled object from XPath expression.
+		// If PUGIXML_NO_EXCEPTIONS is not defined, throws xpath_exception on compilation errors or expressions outside of the supported subset.
+		explicit xpath_stream_query(const char_t* query);
+
+		// Destructor
+		~xpath_stream_query();
+
+		// Parse the document and call handler for every match. Only subtrees of matching elements are loaded into a tree, one at a time,
+		// so memory usage is bounded by the size of the largest matching subtree. Input is treated as UTF-8; UTF-16/UTF-32 input results in status_io_error.
+		// Parsing stops early with status_ok if the handler returns false.
+		xml_parse_result evaluate_file(const char* path, xpath_stream_handler& handler, unsigned int options = parse_default) const;
+		xml_parse_result evaluate_buffer(const void* contents, size_t size, xpath_stream_handler& handler, unsigned int options = parse_default) const;
+
+	#ifndef PUGIXML_NO_STL
+		xml_parse_result evaluate_stream(std::basic_istream<char, std::char_traits<char> >& stream, xpath_stream_handler& handler, unsigned int options = parse_default) const;
+	#endif
+
+		// Get parsing result (used to get compilation errors in PUGIXML_NO_EXCEPTIONS mode)
+		const xpath_parse_result& result() const;
+
+		// Safe bool conversion operator
+		operator unspecified_bool_type() const;
+
+		// Borland C++ workaround
+		bool operator!() const;
+	};
+#endif
+
 	#ifndef PUGIXML_NO_EXCEPTIONS
         #if defined(_MSC_VER)
           // C4275 can be ignored in Visual C++ if you are deriving
@@ -0,0 +1,154 @@
+// Daemon mode for main.cpp: `main <model.xml> --serve <socket path>` loads the kingdom once and
+// then serves simulations over a local Unix socket.
+//
+// Each connection is one session: the client writes query lines, exactly as in a query file, and
+// reads back the simulation output. Sessions run on their own thread with their own
+// KingdomSimulator over the shared model, so one session never sees another's state. Output is
+// written back as soon as it is produced; the server closes the connection when the simulation is
+// over, i.e. after the victory line or once the client has shut down its sending side.
+//   socat -t 60 - UNIX-CONNECT:kingdom.sock < inputs/L1/t1_queries.txt
+//
+// Query lines have to arrive in time order (see KingdomSimulator::streamQuery). Instrumented builds
+// serve one session at a time.
+#ifndef KINGDOM_DAEMON_H
+#define KINGDOM_DAEMON_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "kingdom_simulator.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <streambuf>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Output stream buffer writing to a socket; sync() (std::endl) sends what has been written.
+class SocketOutput : public std::streambuf {
+public:
+    explicit SocketOutput(int socket) : fd(socket) { setp(buffer, buffer + sizeof(buffer)); }
+
+protected:
+    int overflow(int c) override {
+        if (sync() != 0) return traits_type::eof();
+        if (c != traits_type::eof()) {
+            *pptr() = char(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override {
+        const char *data = pbase();
+        while (data < pptr()) {
+            ssize_t sent = ::send(fd, data, size_t(pptr() - data), 0);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return -1; // the client went away
+            data += sent;
+        }
+        setp(buffer, buffer + sizeof(buffer));
+        return 0;
+    }
+
+private:
+    int fd;
+    char buffer[4096];
+};
+
+//---------------------------------------------------------------------
+// Runs one session on a connected socket and closes it.
+inline void serveSession(std::shared_ptr<const KingdomModel> model, int fd) {
+    SocketOutput output(fd);
+    std::ostream out(&output);
+    KingdomSimulator simulator(model, out, 0);
+
+    std::string pending;
+    char chunk[4096];
+    bool reading = true;
+    while (reading && out) {
+        ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) break;
+        pending.append(chunk, size_t(received));
+        size_t start = 0, end;
+        while (reading && (end = pending.find('\n', start)) != std::string::npos) {
+            reading = simulator.streamQuery(pending.substr(start, end - start));
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+    // a last line without a newline counts, as with getline
+    if (reading && !pending.empty())
+        simulator.streamQuery(pending);
+    if (out) {
+        simulator.run();
+        out.flush();
+    }
+    ::close(fd);
+}
+
+//---------------------------------------------------------------------
+// Listens on `path` and serves sessions until the process is stopped; returns false if the socket
+// can't be set up.
+inline bool serveKingdom(std::shared_ptr<const KingdomModel> model, const std::string &path) {
+    // a client that hangs up early shows up as a failed send, not as a signal
+    std::signal(SIGPIPE, SIG_IGN);
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return false;
+    }
+    std::strcpy(address.sun_path, path.c_str());
+
+    // replace the socket a previous server left behind, but nothing else that is in the way
+    struct stat existing;
+    if (::lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Can't listen on " << path << ": it exists and is not a socket" << std::endl;
+            return false;
+        }
+        ::unlink(path.c_str());
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || ::bind(listener, (sockaddr *)&address, sizeof(address)) < 0 || ::listen(listener, SOMAXCONN) < 0) {
+        std::cerr << "Can't listen on " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    while (true) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Can't accept on " << path << ": " << std::strerror(errno) << std::endl;
+            ::close(listener);
+            return false;
+        }
+#ifdef KINGDOM_INSTRUMENTED
+        serveSession(model, fd);
+#else
+        std::thread(serveSession, model, fd).detach();
+#endif
+    }
+}
+
+#else
+
+inline bool serveKingdom(std::shared_ptr<const KingdomModel> /*model*/, const std::string & /*path*/) {
+    std::cerr << "Daemon mode needs Unix domain sockets." << std::endl;
+    return false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,212 @@
+// Query files for main.cpp: `main <model.xml> --queries <file>` reads the queries from a file
+// instead of stdin, and `main --compile` (see kingdom_replay.h) takes the same files.
+//
+// Built with -DKINGDOM_ZLIB (and linked with -lz), gzip-compressed files are read natively - plain
+// files still work, zlib passes them through. A producer thread reads (and decompresses) the file
+// into a ring of large buffers while the caller splits lines out of the filled ones, so
+// decompression overlaps with parsing and queueing the queries instead of running before it.
+// Without zlib, plain files go through the same ring, and gzip files are refused.
+//   g++ -O2 -DKINGDOM_ZLIB solution/main.cpp -o main -I lib/cpp/pugixml-1.14/src -pthread -lz
+//   ./main inputs/L1/t1_model.xml --queries archive/t1_queries.txt.gz
+#ifndef KINGDOM_INPUT_H
+#define KINGDOM_INPUT_H
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef KINGDOM_ZLIB
+#include <zlib.h>
+#endif
+
+// Size and number of the buffers in the ring.
+#ifndef KINGDOM_INPUT_BUFFER_SIZE
+#define KINGDOM_INPUT_BUFFER_SIZE (4 << 20)
+#endif
+#ifndef KINGDOM_INPUT_BUFFERS
+#define KINGDOM_INPUT_BUFFERS 4
+#endif
+
+struct QueryFile {
+#ifdef KINGDOM_ZLIB
+    gzFile file = nullptr;
+#else
+    FILE *file = nullptr;
+#endif
+    std::string path;
+
+    // The ring: buffer i % KINGDOM_INPUT_BUFFERS holds the i-th block of the file. The producer
+    // fills a buffer once the caller has handed it back, i.e. while produced - consumed is below
+    // the buffer count.
+    std::vector<char> buffers[KINGDOM_INPUT_BUFFERS];
+    size_t filled[KINGDOM_INPUT_BUFFERS] = {};
+    uint64_t produced = 0;
+    uint64_t consumed = 0;
+    bool finished = false;  // the producer reached the end of the file, or a read error
+    bool stopping = false;
+    std::string error;      // the read error, if any, starting with the path
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread producer;
+
+    // The unread part of the buffer the caller holds, if any (the one at `consumed`).
+    const char *at = nullptr;
+    const char *end = nullptr;
+    bool holding = false;
+
+    QueryFile() = default;
+    QueryFile(const QueryFile &) = delete;
+    QueryFile &operator=(const QueryFile &) = delete;
+
+    ~QueryFile() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            changed.notify_all();
+        }
+        if (producer.joinable())
+            producer.join();
+#ifdef KINGDOM_ZLIB
+        if (file) gzclose(file);
+#else
+        if (file) std::fclose(file);
+#endif
+    }
+
+    // Opens the file and starts reading it ahead; returns false (with a message) if it can't be read.
+    bool open(const std::string &filePath) {
+        path = filePath;
+#ifdef KINGDOM_ZLIB
+        file = gzopen(path.c_str(), "rb");
+        if (file)
+            gzbuffer(file, 1 << 17);
+#else
+        file = std::fopen(path.c_str(), "rb");
+        if (file) {
+            unsigned char magic[2];
+            bool gzip = std::fread(magic, 1, 2, file) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+            std::rewind(file);
+            if (gzip) {
+                std::cerr << path << " is gzip-compressed; build with -DKINGDOM_ZLIB and -lz to read it" << std::endl;
+                return false;
+            }
+        }
+#endif
+        if (!file) {
+            std::cerr << "Can't read " << path << std::endl;
+            return false;
+        }
+        for (auto &buffer : buffers)
+            buffer.resize(KINGDOM_INPUT_BUFFER_SIZE);
+        producer = std::thread([this] { produce(); });
+        return true;
+    }
+
+    // Reads up to `size` bytes; returns the count, 0 at the end of the file and -1 on an error.
+    long read(char *data, size_t size) {
+#ifdef KINGDOM_ZLIB
+        int count = gzread(file, data, unsigned(size));
+        if (count <= 0) {
+            // a truncated stream reads as the end of the file, with Z_BUF_ERROR set
+            int code;
+            const char *message = gzerror(file, &code);
+            if (code != Z_OK) {
+                // zlib names the file in its messages, but not for every kind of error
+                error = message;
+                if (error.compare(0, path.size() + 2, path + ": ") != 0)
+                    error = path + ": " + error;
+                return -1;
+            }
+        }
+        return count;
+#else
+        size_t count = std::fread(data, 1, size, file);
+        if (count == 0 && std::ferror(file)) {
+            error = path + ": " + std::strerror(errno);
+            return -1;
+        }
+        return long(count);
+#endif
+    }
+
+    void produce() {
+        uint64_t next = 0;
+        bool more = true;
+        while (more) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return stopping || next - consumed < KINGDOM_INPUT_BUFFERS; });
+                if (stopping) return;
+            }
+            std::vector<char> &buffer = buffers[next % KINGDOM_INPUT_BUFFERS];
+            size_t length = 0;
+            while (more && length < buffer.size()) {
+                long count = read(buffer.data() + length, buffer.size() - length);
+                if (count > 0)
+                    length += size_t(count);
+                else
+                    more = false;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            filled[next % KINGDOM_INPUT_BUFFERS] = length;
+            if (length > 0)
+                produced = ++next;
+            finished = !more;
+            changed.notify_all();
+        }
+    }
+
+    // Hands the current buffer back and waits for the next one; returns false at the end of the file.
+    bool nextBuffer() {
+        std::unique_lock<std::mutex> guard(lock);
+        if (holding) {
+            consumed++;
+            holding = false;
+            changed.notify_all();
+        }
+        changed.wait(guard, [&] { return produced > consumed || finished; });
+        if (produced == consumed) return false;
+        holding = true;
+        size_t i = consumed % KINGDOM_INPUT_BUFFERS;
+        at = buffers[i].data();
+        end = at + filled[i];
+        return true;
+    }
+
+    // Next line without its '\n', like std::getline; returns false once the file is exhausted.
+    bool getline(std::string &line) {
+        line.clear();
+        while (true) {
+            if (at != end) {
+                const char *newline = (const char *)std::memchr(at, '\n', size_t(end - at));
+                if (newline) {
+                    line.append(at, newline);
+                    at = newline + 1;
+                    return true;
+                }
+                line.append(at, end);
+                at = end;
+            }
+            if (!nextBuffer()) return !line.empty();
+        }
+    }
+
+    // Whether reading stopped without an error; prints the error otherwise. The producer sets
+    // `error` before `finished`, and may still be reading if the caller stopped early.
+    bool complete() {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!finished) return true;
+        if (!error.empty())
+            std::cerr << "Can't read " << error << std::endl;
+        return error.empty();
+    }
+};
+
+#endif
@@ -0,0 +1,222 @@
+// Hub labels for the road graph of a kingdom model (pruned landmark labeling).
+//
+// Every clan gets a label: a list of (hub, distance) pairs, sorted by hub, such that any two
+// clans share a hub on one of the shortest paths between them. A distance is then the smallest
+// d(a, hub) + d(hub, b) over the common hubs - a merge of two short lists instead of a search.
+// The labels are built by a Dijkstra from every clan in turn, highest degree first, each pruned
+// wherever the labels so far already give the distance.
+//
+// Labels describe the roads of the model with no clan blocked, and need non-negative road times;
+// KingdomSimulator::labelDistances decides when they hold for the live kingdom. They are opt-in:
+// with KINGDOM_HUB_LABELS set, main.cpp reads them from that file if it holds the labels of the
+// model's roads, and otherwise builds them and writes them there for the next run.
+//   KINGDOM_HUB_LABELS=inputs/L1/t1_model.khl ./main inputs/L1/t1_model.xml < inputs/L1/t1_queries.txt
+//
+// File layout, in native byte order: "KHL1", the 64-bit fingerprint of the roads, the clan count,
+// each clan name (as 32-bit length and bytes) in hub order, then the label offsets (clan count + 1),
+// hubs and distances, all 32-bit.
+#ifndef KINGDOM_LABELS_H
+#define KINGDOM_LABELS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct HubLabels {
+    static constexpr int UNREACHABLE = 1000000000;
+
+    std::vector<std::string> names;              // by clan id, which is also its hub order
+    std::unordered_map<std::string, int> ids;
+    std::vector<uint32_t> offsets;               // label of clan i: [offsets[i], offsets[i + 1])
+    std::vector<uint32_t> hubs;
+    std::vector<int> distances;
+    uint64_t fingerprint = 0;
+
+    bool empty() const { return offsets.empty(); }
+
+    // Id of a clan, or -1 if it has no roads.
+    int find(const std::string &name) const {
+        auto id = ids.find(name);
+        return id == ids.end() ? -1 : id->second;
+    }
+
+    // Distance between two clans by id, or UNREACHABLE.
+    int distance(int a, int b) const {
+        uint32_t i = offsets[a], iEnd = offsets[a + 1];
+        uint32_t j = offsets[b], jEnd = offsets[b + 1];
+        int best = UNREACHABLE;
+        while (i < iEnd && j < jEnd) {
+            if (hubs[i] < hubs[j]) {
+                i++;
+            } else if (hubs[j] < hubs[i]) {
+                j++;
+            } else {
+                best = std::min(best, distances[i] + distances[j]);
+                i++;
+                j++;
+            }
+        }
+        return best;
+    }
+
+    // Clan ids of `roads` (a RoadMap, which has every road in both directions): by degree, highest
+    // first, then by name. Returns the fingerprint of the roads under those ids.
+    template <typename Roads>
+    uint64_t number(const Roads &roads, std::vector<std::string> &order, std::unordered_map<std::string, int> &id) const {
+        std::vector<std::pair<size_t, const std::string*>> byDegree;
+        for (auto &p : roads)
+            byDegree.push_back({p.second.size(), &p.first});
+        std::sort(byDegree.begin(), byDegree.end(), [](auto &a, auto &b) {
+            return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+        });
+        order.clear();
+        id.clear();
+        for (auto &node : byDegree) {
+            id[*node.second] = int(order.size());
+            order.push_back(*node.second);
+        }
+        // FNV-1a over the names and the roads of each clan, in id order
+        uint64_t hash = 1469598103934665603ull;
+        auto mix = [&](const void *data, size_t size) {
+            for (size_t i = 0; i < size; i++)
+                hash = (hash ^ static_cast<const unsigned char*>(data)[i]) * 1099511628211ull;
+        };
+        for (const std::string &name : order) {
+            mix(name.data(), name.size() + 1);
+            for (auto &edge : roads.find(name)->second) {
+                int32_t road[2] = {id[edge.first], edge.second};
+                mix(road, sizeof(road));
+            }
+        }
+        return hash;
+    }
+
+    template <typename Roads>
+    void build(const Roads &roads) {
+        fingerprint = number(roads, names, ids);
+        int n = int(names.size());
+        std::vector<uint32_t> edgeOffsets(1, 0), edgeTo;
+        std::vector<int> edgeTime;
+        for (const std::string &name : names) {
+            for (auto &edge : roads.find(name)->second) {
+                edgeTo.push_back(uint32_t(ids[edge.first]));
+                edgeTime.push_back(edge.second);
+            }
+            edgeOffsets.push_back(uint32_t(edgeTo.size()));
+        }
+
+        std::vector<std::vector<std::pair<uint32_t, int>>> labels(n);
+        std::vector<int> rootDistance(n, UNREACHABLE); // by hub: distance from the root's label
+        std::vector<int> dist(n, UNREACHABLE);
+        std::vector<uint32_t> reached;
+        std::priority_queue<std::pair<int, uint32_t>, std::vector<std::pair<int, uint32_t>>, std::greater<std::pair<int, uint32_t>>> frontier;
+        for (int root = 0; root < n; root++) {
+            for (auto &hub : labels[root])
+                rootDistance[hub.first] = hub.second;
+            dist[root] = 0;
+            reached.push_back(uint32_t(root));
+            frontier.push({0, uint32_t(root)});
+            while (!frontier.empty()) {
+                int d = frontier.top().first;
+                uint32_t u = frontier.top().second;
+                frontier.pop();
+                if (d > dist[u]) continue;
+                int known = UNREACHABLE;
+                for (auto &hub : labels[u])
+                    if (rootDistance[hub.first] != UNREACHABLE)
+                        known = std::min(known, rootDistance[hub.first] + hub.second);
+                if (known <= d) continue;
+                labels[u].push_back({uint32_t(root), d});
+                for (uint32_t e = edgeOffsets[u]; e < edgeOffsets[u + 1]; e++) {
+                    uint32_t v = edgeTo[e];
+                    if (d + edgeTime[e] < dist[v]) {
+                        if (dist[v] == UNREACHABLE) reached.push_back(v);
+                        dist[v] = d + edgeTime[e];
+                        frontier.push({dist[v], v});
+                    }
+                }
+            }
+            for (uint32_t v : reached)
+                dist[v] = UNREACHABLE;
+            reached.clear();
+            for (auto &hub : labels[root])
+                rootDistance[hub.first] = UNREACHABLE;
+        }
+
+        offsets.assign(1, 0);
+        hubs.clear();
+        distances.clear();
+        for (auto &label : labels) {
+            for (auto &hub : label) {
+                hubs.push_back(hub.first);
+                distances.push_back(hub.second);
+            }
+            offsets.push_back(uint32_t(hubs.size()));
+        }
+    }
+
+    bool write(const std::string &path) const {
+        std::ofstream out(path, std::ios::binary);
+        uint32_t n = uint32_t(names.size());
+        out.write("KHL1", 4);
+        out.write(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+        out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+        for (const std::string &name : names) {
+            uint32_t length = uint32_t(name.size());
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(name.data(), length);
+        }
+        out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(hubs.data()), hubs.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(distances.data()), distances.size() * sizeof(int));
+        return bool(out.flush());
+    }
+
+    // Reads the labels in `path` if they are the labels of `roads`; otherwise returns false and
+    // leaves the labels empty.
+    template <typename Roads>
+    bool read(const std::string &path, const Roads &roads) {
+        std::ifstream in(path, std::ios::binary);
+        auto get = [&](void *data, size_t size) { return bool(in.read(static_cast<char*>(data), std::streamsize(size))); };
+        char magic[4];
+        uint64_t stored;
+        uint32_t n;
+        if (!in || !get(magic, 4) || std::memcmp(magic, "KHL1", 4) != 0 || !get(&stored, sizeof(stored)) || !get(&n, sizeof(n)))
+            return false;
+        fingerprint = number(roads, names, ids);
+        bool valid = stored == fingerprint && n == names.size();
+        for (uint32_t i = 0; valid && i < n; i++) {
+            uint32_t length;
+            valid = get(&length, sizeof(length)) && length == names[i].size();
+            std::string name(valid ? length : 0, '\0');
+            valid = valid && get(&name[0], length) && name == names[i];
+        }
+        if (valid) {
+            offsets.resize(size_t(n) + 1);
+            valid = get(offsets.data(), offsets.size() * sizeof(uint32_t)) && offsets[0] == 0;
+            for (uint32_t i = 0; valid && i < n; i++)
+                valid = offsets[i] <= offsets[i + 1];
+        }
+        if (valid) {
+            hubs.resize(offsets[n]);
+            distances.resize(offsets[n]);
+            valid = get(hubs.data(), hubs.size() * sizeof(uint32_t)) && get(distances.data(), distances.size() * sizeof(int));
+            // every label sorted by hub, as distance() merges them
+            for (uint32_t i = 0; valid && i < n; i++)
+                for (uint32_t k = offsets[i]; valid && k < offsets[i + 1]; k++)
+                    valid = hubs[k] < n && (k == offsets[i] || hubs[k - 1] < hubs[k]);
+        }
+        if (!valid)
+            *this = HubLabels();
+        return valid;
+    }
+};
+
+#endif
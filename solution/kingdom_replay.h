@@ -0,0 +1,383 @@
+// Compiled query traces for main.cpp. `main --compile <queries.txt> <trace.kqt>` turns a text query
+// trace (read as in kingdom_input.h, so it may be gzip-compressed) into a compact binary one, and
+// `main <model.xml> --replay <trace.kqt>` runs the simulation on it instead of on stdin. The
+// compiled trace is mapped into memory and replayed without any of the input parsing - no line
+// splitting, number conversion or event classification - which pays off for traces that are
+// replayed many times.
+//
+// Layout; integers are LEB128 varints, signed ones zigzag-encoded:
+//   "KQT1"
+//   name count, then each clan name as length and bytes
+//   record count, then the records
+// A record is a tag byte, its time as the (signed) difference to the previous record's time, and
+// the fields of its kind, as in recordTemplate: clans are indexes into the name table, numbers
+// signed varints, and a new clan also has its road count. The tag is the EventKind, plus
+// RECORD_CR if the line ended in '\r' (as in CRLF query files), or RECORD_TEXT for an event
+// stored as length and text instead: any event that isn't exactly what its fields render to.
+// Replay thus schedules the same (time, event text) pairs as addQuery on the text trace, and
+// produces the same output.
+#ifndef KINGDOM_REPLAY_H
+#define KINGDOM_REPLAY_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "kingdom_input.h"
+#include "kingdom_simulator.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define KINGDOM_REPLAY_MMAP
+#endif
+
+static const char compiledTraceMagic[4] = {'K', 'Q', 'T', '1'};
+
+enum : uint8_t {
+    RECORD_KIND = 0x1f,  // EventKind
+    RECORD_CR = 0x40,    // the event text ends in '\r'
+    RECORD_TEXT = 0x80,  // the event is stored as text
+};
+
+// Event text of the kinds stored as fields: %n is a clan and %i an integer. A new clan is followed
+// by its roads in roadTemplate, separated by ", ".
+inline const char *recordTemplate(EventKind kind) {
+    switch (kind) {
+    case EV_ATTACK: return "Attack on %n with %i RR providing %i GCO";
+    case EV_NEW_MINE: return "%n has found natural resource's mine with %i MAR, %i PTR and %i RT";
+    case EV_NEW_CLAN: return "New %n has been formed, which has the connectivity to ";
+    case EV_BLOCK: return "%n has been blocked by enemies for %i seconds";
+    case EV_STATUS: return "Show the current status of all the clans with mines";
+    case EV_PRODUCE_GOLD: return "Produce the current amount of Gold captured";
+    case EV_PROCESS_INPUTS: return "Process inputs";
+    case EV_VICTORY: return "Victory of Codeopia";
+    default: return nullptr;
+    }
+}
+
+static const char *const roadTemplate = "%n(with %i time)";
+
+//---------------------------------------------------------------------
+inline void writeVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+inline void writeSignedVarint(std::string &out, int64_t value) {
+    writeVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+// Reads varints from a byte range; a read past its end returns 0 and clears `ok`.
+struct RecordReader {
+    const uint8_t *at;
+    const uint8_t *end;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (at == end) break;
+            uint8_t byte = *at++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+    int64_t signedVarint() {
+        uint64_t value = varint();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+    std::string_view bytes(uint64_t length) {
+        if (uint64_t(end - at) < length) {
+            ok = false;
+            return {};
+        }
+        std::string_view text((const char *)at, size_t(length));
+        at += length;
+        return text;
+    }
+};
+
+// Appends the text of `pattern` with its fields read from `fields`; returns false if the record
+// is cut short or names a clan that isn't in `names`.
+inline bool renderRecord(const char *pattern, RecordReader &fields, const std::vector<std::string_view> &names, std::string &text) {
+    for (const char *p = pattern; *p; p++) {
+        if (p[0] != '%' || !p[1]) {
+            text += *p;
+            continue;
+        }
+        if (*++p == 'n') {
+            uint64_t id = fields.varint();
+            if (id >= names.size()) return false;
+            text.append(names[id].data(), names[id].size());
+        } else {
+            char digits[24];
+            auto written = std::to_chars(digits, digits + sizeof(digits), fields.signedVarint());
+            text.append(digits, written.ptr);
+        }
+    }
+    return fields.ok;
+}
+
+//---------------------------------------------------------------------
+// Builds a compiled trace from (time, event) pairs.
+struct TraceCompiler {
+    std::vector<std::string> names;
+    std::unordered_map<std::string, uint64_t> nameIds;
+    std::string records;
+    uint64_t recordCount = 0;
+    int previousTime = 0;
+
+    uint64_t nameId(std::string_view name) {
+        auto known = nameIds.emplace(std::string(name), names.size());
+        if (known.second)
+            names.emplace_back(name);
+        return known.first->second;
+    }
+
+    // Matches event[at..] against pattern, appending its fields; returns the end of the match, or
+    // npos if it doesn't match. A field runs up to the first occurrence of the text after it.
+    size_t match(const char *pattern, std::string_view event, size_t at, std::string &fields) {
+        for (const char *p = pattern; *p;) {
+            if (p[0] != '%' || !p[1]) {
+                if (at >= event.size() || event[at] != *p) return std::string_view::npos;
+                at++;
+                p++;
+                continue;
+            }
+            char field = p[1];
+            p += 2;
+            std::string_view next(p, std::strcspn(p, "%"));
+            size_t end = next.empty() ? event.size() : event.find(next, at);
+            if (end == std::string_view::npos || end == at) return std::string_view::npos;
+            std::string_view value = event.substr(at, end - at);
+            if (field == 'n') {
+                writeVarint(fields, nameId(value));
+            } else {
+                // only numbers that print back the same, e.g. not "007" or "+7"
+                long long number;
+                auto parsed = std::from_chars(value.data(), value.data() + value.size(), number);
+                if (parsed.ec != std::errc() || parsed.ptr != value.data() + value.size() || value[0] == '+' ||
+                    (value.size() > 1 && (value[0] == '0' || (value[0] == '-' && value[1] == '0'))))
+                    return std::string_view::npos;
+                writeSignedVarint(fields, number);
+            }
+            at = end;
+        }
+        return at;
+    }
+
+    // The fields of `event` as a record of its kind, if it is exactly what they render to.
+    bool encodeFields(EventKind kind, std::string_view event, std::string &fields) {
+        const char *pattern = recordTemplate(kind);
+        if (!pattern) return false;
+        size_t at = match(pattern, event, 0, fields);
+        if (at == std::string_view::npos) return false;
+        if (kind == EV_NEW_CLAN) {
+            std::string roads;
+            uint64_t count = 0;
+            while (at < event.size()) {
+                if (count > 0) {
+                    if (event.compare(at, 2, ", ") != 0) return false;
+                    at += 2;
+                }
+                at = match(roadTemplate, event, at, roads);
+                if (at == std::string_view::npos) return false;
+                count++;
+            }
+            writeVarint(fields, count);
+            fields += roads;
+        }
+        return at == event.size();
+    }
+
+    void add(int time, const std::string &event) {
+        EventKind kind = classifyEvent(event);
+        uint8_t tag = uint8_t(kind);
+        std::string_view text(event);
+        if (!text.empty() && text.back() == '\r') {
+            tag |= RECORD_CR;
+            text.remove_suffix(1);
+        }
+        std::string fields;
+        size_t knownNames = names.size();
+        if (!encodeFields(kind, text, fields)) {
+            // forget the names of a partial match
+            for (size_t i = knownNames; i < names.size(); i++)
+                nameIds.erase(names[i]);
+            names.resize(knownNames);
+            tag = uint8_t(kind) | RECORD_TEXT;
+            fields.clear();
+            writeVarint(fields, event.size());
+            fields += event;
+        }
+        records += char(tag);
+        writeSignedVarint(records, int64_t(time) - previousTime);
+        records += fields;
+        previousTime = time;
+        recordCount++;
+    }
+
+    void write(std::ostream &out) const {
+        std::string header(compiledTraceMagic, sizeof(compiledTraceMagic));
+        writeVarint(header, names.size());
+        for (auto &name : names) {
+            writeVarint(header, name.size());
+            header += name;
+        }
+        writeVarint(header, recordCount);
+        out.write(header.data(), header.size());
+        out.write(records.data(), records.size());
+    }
+};
+
+//---------------------------------------------------------------------
+// Compiles query lines the way main.cpp reads them: lines without a time are skipped, and the
+// trace ends with the victory line.
+inline void compileQueries(QueryFile &in, std::ostream &out) {
+    TraceCompiler compiler;
+    std::string query;
+    int time;
+    std::string event;
+    while (in.getline(query)) {
+        if (!parseQuery(query, time, event)) continue;
+        compiler.add(time, event);
+        if (query.find("Victory of Codeopia") != std::string::npos) break;
+    }
+    compiler.write(out);
+}
+
+inline bool compileQueryFile(const std::string &queriesPath, const std::string &tracePath) {
+    QueryFile in;
+    if (!in.open(queriesPath))
+        return false;
+    std::ofstream out(tracePath, std::ios::binary);
+    compileQueries(in, out);
+    if (!in.complete())
+        return false;
+    if (!out.flush()) {
+        std::cerr << "Can't write " << tracePath << std::endl;
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------
+// A compiled trace, mapped into memory (read into it where there is no mmap).
+struct CompiledTrace {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::vector<char> copy;
+    std::vector<std::string_view> names; // into the mapping
+    RecordReader records{nullptr, nullptr};
+    uint64_t recordCount = 0;
+
+    CompiledTrace() = default;
+    CompiledTrace(const CompiledTrace &) = delete;
+    CompiledTrace &operator=(const CompiledTrace &) = delete;
+
+    ~CompiledTrace() {
+#ifdef KINGDOM_REPLAY_MMAP
+        if (mapped)
+            ::munmap((void *)data, size);
+#endif
+    }
+
+    // Maps the file and reads its header; returns false (with a message) if it isn't a compiled trace.
+    bool open(const std::string &path) {
+#ifdef KINGDOM_REPLAY_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd >= 0 && ::fstat(fd, &status) == 0 && status.st_size > 0) {
+            void *file = ::mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (file != MAP_FAILED) {
+                data = (const uint8_t *)file;
+                size = size_t(status.st_size);
+                mapped = true;
+            }
+        }
+        if (fd >= 0)
+            ::close(fd);
+#endif
+        if (!mapped) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) {
+                std::cerr << "Can't read " << path << std::endl;
+                return false;
+            }
+            copy.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+            data = (const uint8_t *)copy.data();
+            size = copy.size();
+        }
+        if (size < sizeof(compiledTraceMagic) || std::memcmp(data, compiledTraceMagic, sizeof(compiledTraceMagic)) != 0) {
+            std::cerr << "Not a compiled query trace: " << path << std::endl;
+            return false;
+        }
+        RecordReader header{data + sizeof(compiledTraceMagic), data + size};
+        uint64_t nameCount = header.varint();
+        for (uint64_t i = 0; i < nameCount && header.ok; i++)
+            names.push_back(header.bytes(header.varint()));
+        recordCount = header.varint();
+        records = header;
+        if (!header.ok) {
+            std::cerr << "Truncated query trace: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Schedules every record as an input event of the simulation; returns false (with a message)
+    // at the first malformed record, leaving the ones before it scheduled.
+    bool replay(KingdomSimulator &simulator) const {
+        RecordReader reader = records;
+        std::string text;
+        int64_t time = 0;
+        for (uint64_t i = 0; i < recordCount; i++) {
+            uint8_t tag = reader.at < reader.end ? *reader.at++ : 0xff;
+            EventKind kind = EventKind(tag & RECORD_KIND);
+            time += reader.signedVarint();
+            text.clear();
+            bool valid = kind < EV_COUNT;
+            if (valid && (tag & RECORD_TEXT)) {
+                std::string_view stored = reader.bytes(reader.varint());
+                text.append(stored.data(), stored.size());
+                valid = reader.ok;
+            } else if (valid) {
+                const char *pattern = recordTemplate(kind);
+                valid = pattern && renderRecord(pattern, reader, names, text);
+                if (valid && kind == EV_NEW_CLAN) {
+                    uint64_t roads = reader.varint();
+                    for (uint64_t r = 0; r < roads && valid; r++) {
+                        if (r > 0) text += ", ";
+                        valid = renderRecord(roadTemplate, reader, names, text);
+                    }
+                }
+                if (tag & RECORD_CR)
+                    text += '\r';
+            }
+            if (!valid || !reader.ok) {
+                std::cerr << "Malformed query trace record " << i << std::endl;
+                return false;
+            }
+            simulator.scheduleInput(int(time), text, kind);
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,2053 @@
+// Simulation engine for main.cpp: a kingdom model loaded once, and any number of simulations on it.
+//
+// KingdomModel holds the parsed XML (clans and roads, and optionally their hub labels) and is not
+// modified after loading, so one model can be shared by simulations running on different threads.
+// A KingdomSimulator owns all mutable state of one run - clan state, roads added by new clans, the
+// event queue, the gold counter and its worker threads - and writes its output to the stream it
+// was given.
+//
+// The instrumentation in kingdom_stats.h and kingdom_trace.h is process-wide; instrumented builds
+// are meant for one simulation at a time.
+#ifndef KINGDOM_SIMULATOR_H
+#define KINGDOM_SIMULATOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "../lib/cpp/pugixml-1.14/src/pugixml.hpp"
+#include "kingdom_labels.h"
+#include "kingdom_stats.h"
+#include "kingdom_trace.h"
+
+// Instrumentation of one handled event; compiles to nothing unless KINGDOM_STATS or KINGDOM_TRACE is defined.
+// Instrumented builds handle every event on its own, on the simulation's thread.
+#define EVENT_SCOPE(kind, time, event) STATS_SCOPE(kind); TRACE_SCOPE(kind, time, event)
+#if defined(KINGDOM_STATS) || defined(KINGDOM_TRACE)
+#define KINGDOM_INSTRUMENTED
+#endif
+
+struct Clan {
+    std::string name;
+    bool isMine = false;
+    int MAR = 0;    // Maximum Available Resources
+    int PTR = 0;    // Processing Time per Resource
+    int RT = 0;     // Refill Time
+    int availableResources = 0; // When idle, equals MAR
+    // Processing state:
+    bool inProcessing = false;
+    int processingTotal = 0;
+    int processingStartTime = 0;
+    // Blocking:
+    bool isBlocked = false;
+    int blockedUntil = 0;
+    // Position among the simulation's clans, for per-clan arrays (mine indexes, mine cycles).
+    int slot = -1;
+};
+
+typedef std::vector<std::pair<std::string, int>> RoadList;   // (other clan, travel time)
+typedef std::unordered_map<std::string, RoadList> RoadMap;
+
+//---------------------------------------------------------------------
+// The kingdom as described by the model XML.
+struct KingdomModel {
+    std::unordered_map<std::string, Clan> clans;
+    RoadMap roads;
+    // Range of road times; picks the Dijkstra frontier.
+    int minRoadTime = 0;
+    int maxRoadTime = 0;
+    // Hub labels of the roads, if useHubLabels was called (see kingdom_labels.h).
+    HubLabels hubLabels;
+
+    void addRoad(const std::string &from, const std::string &to, int travelTime) {
+        roads[from].push_back({to, travelTime});
+        roads[to].push_back({from, travelTime});
+        minRoadTime = std::min(minRoadTime, travelTime);
+        maxRoadTime = std::max(maxRoadTime, travelTime);
+    }
+
+    // XML Parsing: loads clan and road data.
+    // For mines, sets availableResources = MAR. Returns false (leaving the model empty) if the file can't be parsed.
+    bool load(const std::string &path) {
+        pugi::xml_document doc;
+        // MAR/PTR/RT/Time are plain decimals; take the from_chars fast path for them.
+        if (!doc.load_file(path.c_str(), pugi::parse_default | pugi::parse_fast_numbers))
+            return false;
+        pugi::xml_node kingdom = doc.child("Kingdom");
+        for (pugi::xml_node clanNode : kingdom.children("Clan")) {
+            std::string name = clanNode.child("Name").text().as_string();
+            bool isMine = std::string(clanNode.child("IS_MINE").text().as_string()) == "True";
+            Clan c;
+            c.name = name;
+            c.isMine = isMine;
+            if (isMine) {
+                c.MAR = clanNode.child("MAR").text().as_int();
+                c.PTR = clanNode.child("PTR").text().as_int();
+                c.RT  = clanNode.child("RT").text().as_int();
+                c.availableResources = c.MAR;
+            }
+            clans[name] = c;
+        }
+        for (pugi::xml_node roadNode : kingdom.children("Road")) {
+            std::string from = roadNode.child("From").text().as_string();
+            std::string to   = roadNode.child("To").text().as_string();
+            int travelTime = roadNode.child("Time").text().as_int();
+            addRoad(from, to, travelTime);
+        }
+        return true;
+    }
+
+    // Loads the hub labels of the roads from `path`, or builds them and writes them there if it
+    // doesn't hold them. Returns false, without labels, if a road time is negative.
+    bool useHubLabels(const std::string &path) {
+        if (minRoadTime < 0) return false;
+        if (!hubLabels.read(path, roads)) {
+            hubLabels.build(roads);
+            if (!hubLabels.write(path))
+                std::cerr << "Can't write " << path << std::endl;
+        }
+        return true;
+    }
+};
+
+//---------------------------------------------------------------------
+// Dijkstra frontiers. Road times are small non-negative integers, so besides the binary heap there
+// are two monotone integer queues: Dial's buckets (a ring of maxRoadTime + 1 buckets, one distance
+// per bucket) for small road times, and a radix heap (a bucket per highest bit that differs from the
+// last popped distance) for anything larger. All of them pop in non-decreasing distance, so the
+// distances they produce are the same; negative road times always use the binary heap.
+enum ShortestPathQueue { QUEUE_AUTO, QUEUE_BINARY_HEAP, QUEUE_BUCKETS, QUEUE_RADIX_HEAP };
+
+// Largest road time for which QUEUE_AUTO picks Dial's buckets.
+#ifndef KINGDOM_BUCKET_MAX_ROAD_TIME
+#define KINGDOM_BUCKET_MAX_ROAD_TIME 1024
+#endif
+
+typedef std::pair<int, const std::string*> FrontierEntry; // (distance, clan)
+
+struct BinaryHeapFrontier {
+    struct Later {
+        bool operator()(const FrontierEntry &a, const FrontierEntry &b) const { return a.first > b.first; }
+    };
+    std::priority_queue<FrontierEntry, std::vector<FrontierEntry>, Later> heap;
+
+    void reset(int /*maxRoadTime*/) { heap = decltype(heap)(); }
+    bool empty() const { return heap.empty(); }
+    void push(int d, const std::string *clan) { heap.push({d, clan}); }
+    FrontierEntry pop() {
+        FrontierEntry e = heap.top();
+        heap.pop();
+        return e;
+    }
+};
+
+struct BucketFrontier {
+    std::vector<std::vector<FrontierEntry>> buckets;
+    size_t count = 0;
+    int current = 0;
+
+    void reset(int maxRoadTime) {
+        for (auto &b : buckets) b.clear();
+        buckets.resize(maxRoadTime + 1);
+        count = 0;
+        current = 0;
+    }
+    bool empty() const { return count == 0; }
+    void push(int d, const std::string *clan) {
+        buckets[d % buckets.size()].push_back({d, clan});
+        count++;
+    }
+    FrontierEntry pop() {
+        // queued distances all lie in [current, current + maxRoadTime]
+        while (buckets[current % buckets.size()].empty()) current++;
+        std::vector<FrontierEntry> &bucket = buckets[current % buckets.size()];
+        FrontierEntry e = bucket.back();
+        bucket.pop_back();
+        count--;
+        return e;
+    }
+};
+
+struct RadixHeapFrontier {
+    std::vector<FrontierEntry> buckets[33];
+    size_t count = 0;
+    unsigned last = 0;
+
+    static int bucketOf(unsigned bits) {
+#if defined(__GNUC__)
+        return bits ? 32 - __builtin_clz(bits) : 0;
+#else
+        int b = 0;
+        while (bits) { bits >>= 1; b++; }
+        return b;
+#endif
+    }
+    void reset(int /*maxRoadTime*/) {
+        for (auto &b : buckets) b.clear();
+        count = 0;
+        last = 0;
+    }
+    bool empty() const { return count == 0; }
+    void push(int d, const std::string *clan) {
+        buckets[bucketOf(unsigned(d) ^ last)].push_back({d, clan});
+        count++;
+    }
+    FrontierEntry pop() {
+        if (buckets[0].empty()) {
+            // move the lowest non-empty bucket down around its minimum
+            int i = 1;
+            while (buckets[i].empty()) i++;
+            last = unsigned(std::min_element(buckets[i].begin(), buckets[i].end())->first);
+            for (auto &e : buckets[i])
+                buckets[bucketOf(unsigned(e.first) ^ last)].push_back(e);
+            buckets[i].clear();
+        }
+        FrontierEntry e = buckets[0].back();
+        buckets[0].pop_back();
+        count--;
+        return e;
+    }
+};
+
+//---------------------------------------------------------------------
+// Distances by clan name. The event loop keeps the maps of its searches in PooledDistances and
+// clears them for the next search, which hands their nodes back to the map's own pool, so searches
+// stop allocating once the map has grown to the largest of them (names of up to 15 characters are
+// kept in the nodes). The pool isn't thread-safe: one map per thread at a time.
+typedef std::pmr::unordered_map<std::string, int> DistanceMap;
+
+struct PooledDistances {
+    std::pmr::unsynchronized_pool_resource pool;
+    DistanceMap dist{&pool};
+};
+
+//---------------------------------------------------------------------
+// Dijkstra from start over `routes`, filling dist; stops at *end if given and returns its distance,
+// or 1e9 if it is unreachable. Blocked clans can't be passed through or reached. Road endpoints that
+// aren't known clans count as open; KingdomSimulator doesn't search from a clan that can reach one
+// this way (see KingdomSimulator::baselineAttack).
+template <typename Frontier, typename Routes>
+int shortestPaths(Frontier &frontier, const Routes &routes, const std::string &start, const std::string *end, DistanceMap &dist) {
+    frontier.reset(routes.maxTime());
+    dist[start] = 0;
+    frontier.push(0, &start);
+    while (!frontier.empty()) {
+        FrontierEntry it = frontier.pop();
+        int d = it.first;
+        const std::string &u = *it.second;
+        if (end && u == *end) return d;
+        if (d > dist[u]) continue;
+        routes.settled();
+        const RoadList *roads = routes.roadsFrom(u);
+        if (!roads) continue;
+        for (auto &edge : *roads) {
+            const std::string &v = edge.first;
+            if (routes.isBlocked(v)) continue;
+            int w = edge.second;
+            auto known = dist.find(v);
+            if (known == dist.end() || d + w < known->second) {
+                dist[v] = d + w;
+                frontier.push(d + w, &v);
+            }
+        }
+    }
+    return 1e9;
+}
+
+// Runs shortestPaths with the frontier picked by `queue` and the range of road times.
+template <typename Routes>
+int shortestPaths(ShortestPathQueue queue, const Routes &routes, const std::string &start, const std::string *end, DistanceMap &dist) {
+    if (routes.minTime() < 0)
+        queue = QUEUE_BINARY_HEAP;
+    else if (queue == QUEUE_AUTO)
+        queue = routes.maxTime() <= KINGDOM_BUCKET_MAX_ROAD_TIME ? QUEUE_BUCKETS : QUEUE_RADIX_HEAP;
+    // one frontier of each kind per thread, so their buffers are reused between searches
+    if (queue == QUEUE_BUCKETS) {
+        thread_local BucketFrontier buckets;
+        return shortestPaths(buckets, routes, start, end, dist);
+    }
+    if (queue == QUEUE_RADIX_HEAP) {
+        thread_local RadixHeapFrontier radixHeap;
+        return shortestPaths(radixHeap, routes, start, end, dist);
+    }
+    thread_local BinaryHeapFrontier heap;
+    return shortestPaths(heap, routes, start, end, dist);
+}
+
+//---------------------------------------------------------------------
+// Number of worker threads: KINGDOM_THREADS, or one less than the hardware threads.
+inline int workerThreadCount() {
+    const char *threads = std::getenv("KINGDOM_THREADS");
+    int workers = threads ? std::atoi(threads) : int(std::thread::hardware_concurrency()) - 1;
+    return std::max(workers, 0);
+}
+
+//---------------------------------------------------------------------
+// Fork-join pool for loops whose iterations are independent; the calling thread takes part.
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    const std::function<void(size_t)> *body = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> nextIndex{0};
+    size_t active = 0;       // pool threads not done with the current loop
+    uint64_t generation = 0; // bumped for every loop
+    bool stopping = false;
+
+    void start(int workers) {
+        stopping = false;
+        // taken here, not in the thread, so a loop started before the thread runs isn't missed
+        uint64_t seen = generation;
+        for (int i = 0; i < workers; i++)
+            threads.emplace_back([this, seen] { work(seen); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &t : threads)
+            t.join();
+        threads.clear();
+    }
+
+    void share() {
+        for (size_t i = nextIndex++; i < count; i = nextIndex++)
+            (*body)(i);
+    }
+
+    void work(uint64_t seen) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            guard.unlock();
+            share();
+            guard.lock();
+            if (--active == 0) finished.notify_all();
+        }
+    }
+
+    // Runs f(0) .. f(n - 1) spread over the pool and returns once all of them are done.
+    void run(size_t n, const std::function<void(size_t)> &f) {
+        if (threads.empty()) {
+            for (size_t i = 0; i < n; i++) f(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            body = &f;
+            count = n;
+            nextIndex = 0;
+            active = threads.size();
+            generation++;
+        }
+        wake.notify_all();
+        share();
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&] { return active == 0; });
+    }
+};
+
+// What a handler scheduled or credited while running as part of a parallel batch;
+// applied in batch order once the whole batch is done.
+struct DeferredEffects {
+    std::vector<std::pair<int, std::string>> events;
+    std::vector<double> gold;
+    std::vector<std::string> mines; // mines whose available resources changed
+    std::vector<int> cycles;        // slots of clans whose pending transitions changed
+    std::vector<EventKind> elided;
+};
+
+static thread_local DeferredEffects *deferredEffects = nullptr;
+
+//---------------------------------------------------------------------
+// Speculative attack evaluation.
+// Attacks only come from the input, so all of them are known before processEvents starts, and the
+// route part of an attack depends on nothing but the roads and the blocked clans. Worker threads
+// (see workerThreadCount) run ahead of the event loop and compute the
+// distances from upcoming attack targets on a snapshot of that routing state, tagged with
+// routingVersion. When the event loop reaches the attack it commits the result only if no road or
+// block changed since; otherwise the result is rolled back and the attack is evaluated in place.
+// Mine state is always read live, so the output is the same as a sequential run.
+struct RoutingSnapshot {
+    uint64_t version = 0;
+    std::shared_ptr<const KingdomModel> model;
+    RoadMap changedRoads;
+    std::unordered_set<std::string> blocked;
+    int minRoadTime = 0;
+    int maxRoadTime = 0;
+
+    const RoadList *roadsFrom(const std::string &clan) const {
+        auto changed = changedRoads.find(clan);
+        if (changed != changedRoads.end()) return &changed->second;
+        auto r = model->roads.find(clan);
+        return r == model->roads.end() ? nullptr : &r->second;
+    }
+    bool isBlocked(const std::string &clan) const { return blocked.count(clan) != 0; }
+    int minTime() const { return minRoadTime; }
+    int maxTime() const { return maxRoadTime; }
+    void settled() const {}
+};
+
+struct SpeculativeAttack {
+    std::string target;
+    bool running = false;
+    bool done = false;
+    uint64_t version = 0;                      // routing version of the (running or finished) evaluation
+    DistanceMap dist;                          // distance from target to every reachable clan
+};
+
+struct AttackSpeculation {
+    std::vector<SpeculativeAttack> attacks; // input attacks, in the order processEvents handles them
+    size_t next = 0;                        // index of the next attack the event loop handles
+    size_t window = 0;                      // how many attacks ahead workers may run
+    std::shared_ptr<const RoutingSnapshot> snapshot;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable changed;
+    bool stopping = false;
+};
+
+//---------------------------------------------------------------------
+// Mine cycles. The completeProcessing and refill of a mine don't go through the event queue:
+// startProcessing leaves them as pending transitions of the mine, which are applied when
+// something next looks at it - an attack, status, gold, or another event for that mine. A
+// transition is applied before an event exactly when its event would have been handled first, by
+// (time, event text) as in the queue; the text is only built when the times are equal.
+struct MineTransition {
+    int time;
+    bool refill;  // refill, else completeProcessing
+    double gold;  // credited by completeProcessing
+};
+
+// Pending transitions of a clan, by time; completeProcessing first at the same time.
+typedef std::vector<MineTransition> MineCycle;
+
+//---------------------------------------------------------------------
+// No-op events. Some events are known to change nothing, and are skipped (counted per kind in
+// KingdomSimulator::elidedEvents):
+// - "Process inputs" markers and lines that aren't any known event are never queued;
+// - a refill on a mine that is already full doesn't touch the mine indexes;
+// - an unblock on a clan that isn't blocked changes nothing, not even the routing version.
+// Repeated blocks of a clan coalesce: each block still has its own deadline, but only the
+// earliest pending one is queued. The clan is unblocked by that one, after which the later
+// deadlines are no-ops - unless the clan is blocked again first, which then queues the earliest
+// of them again. Deadlines left over from before that block are dropped unqueued.
+struct ClanUnblocks {
+    std::vector<int> queued;   // unblock times in the event queue
+    std::vector<int> dormant;  // unblock times held back
+};
+
+//---------------------------------------------------------------------
+// Mine index for attacks on one target: the mines reachable from it, ordered by round trip time,
+// under a max segment tree of their available resources. The closest mine with at least RR
+// available is then a descent in the tree instead of a scan and sort over all mines. The order
+// only depends on the routing state, so an index stays valid (and attacks on its target need no
+// search) until the next road or block change; mine updates just set their leaf. An index that is
+// out of date is rebuilt in place when its target is attacked again, reusing its buffers.
+// A clan that becomes a mine is added to each index when it is next used, with the distance from
+// one point-to-point search.
+//
+// Mines with the same round trip time are tied in the scan, which picks between them by the
+// unstable std::sort of the candidates. The index only answers when the closest tier with enough
+// resources has a single such mine; otherwise the attack falls back to the scan over the index.
+//
+// Indexes are kept for the most recently attacked targets; the least recently used ones are
+// dropped before an attack (or batch of them) would take the count past this.
+#ifndef KINGDOM_MINE_INDEX_TARGETS
+#define KINGDOM_MINE_INDEX_TARGETS 64
+#endif
+
+struct MineIndex {
+    std::vector<const std::string*> mines;        // by round trip time, then name
+    std::vector<int> travel;                      // round trip time of each mine
+    std::vector<int> tierEnd;                     // first position with a longer round trip
+    std::vector<int> position;                    // by mine slot; -1 if unreachable
+    std::vector<int> tree;                        // max available resources; leaves from `leaves` on
+    int leaves = 1;
+    uint64_t lastUse = 0;                         // KingdomSimulator::mineIndexUses when last used
+    uint64_t version = 0;                         // KingdomSimulator::routingVersion it was built for
+    size_t minesAdded = 0;                        // how many of KingdomSimulator::addedMines it has
+
+    void set(int i, int available) {
+        i += leaves;
+        tree[i] = available;
+        for (i /= 2; i > 0; i /= 2)
+            tree[i] = std::max(tree[2 * i], tree[2 * i + 1]);
+    }
+
+    // First position in [from, to) whose mine has at least `amount` (> 0) available, or -1.
+    int firstAtLeast(int from, int to, int amount) const { return firstAtLeast(1, 0, leaves, from, to, amount); }
+
+    int firstAtLeast(int node, int low, int high, int from, int to, int amount) const {
+        if (high <= from || to <= low || tree[node] < amount) return -1;
+        if (high - low == 1) return low;
+        int middle = (low + high) / 2;
+        int left = firstAtLeast(2 * node, low, middle, from, to, amount);
+        return left >= 0 ? left : firstAtLeast(2 * node + 1, middle, high, from, to, amount);
+    }
+};
+
+//---------------------------------------------------------------------
+// Classifies an event the way the simulation handles it; the first matching pattern wins.
+inline EventKind classifyEvent(const std::string &event) {
+    if (event.find("Attack on") != std::string::npos) return EV_ATTACK;
+    if (event.find("has found natural resource") != std::string::npos) return EV_NEW_MINE;
+    if (event.find("has been formed") != std::string::npos) return EV_NEW_CLAN;
+    if (event.find("has been blocked by enemies") != std::string::npos) return EV_BLOCK;
+    if (event.rfind("unblock", 0) == 0) return EV_UNBLOCK;
+    if (event.rfind("startProcessing", 0) == 0) return EV_START_PROCESSING;
+    if (event.rfind("completeProcessing", 0) == 0) return EV_COMPLETE_PROCESSING;
+    if (event.find("Show the current status") != std::string::npos) return EV_STATUS;
+    if (event.find("Produce the current amount of Gold captured") != std::string::npos) return EV_PRODUCE_GOLD;
+    if (event.rfind("refill", 0) == 0) return EV_REFILL;
+    if (event.find("Process inputs") != std::string::npos) return EV_PROCESS_INPUTS;
+    if (event.find("Victory of Codeopia") != std::string::npos) return EV_VICTORY;
+    return EV_UNKNOWN;
+}
+
+//---------------------------------------------------------------------
+// Splits an input line "<time>: <event>"; returns false if the line has no time prefix.
+inline bool parseQuery(const std::string &query, int &time, std::string &event) {
+    size_t colonPos = query.find(':');
+    if (colonPos == std::string::npos) return false;
+    time = std::stoi(query.substr(0, colonPos));
+    event = query.substr(colonPos + 2);
+    return true;
+}
+
+//---------------------------------------------------------------------
+// Reads the whitespace-separated words of an event like `std::istringstream >>` does, without
+// copying the event: words are views into it, and numbers are parsed in place (0 if there is none).
+struct WordReader {
+    const std::string &text;
+    size_t at = 0;
+
+    explicit WordReader(const std::string &event) : text(event) {}
+
+    std::string_view word() {
+        while (at < text.size() && std::isspace((unsigned char)text[at])) at++;
+        size_t start = at;
+        while (at < text.size() && !std::isspace((unsigned char)text[at])) at++;
+        return std::string_view(text).substr(start, at - start);
+    }
+    // the text is null-terminated, and strtol/strtod stop at the space after the word
+    int integer() {
+        std::string_view w = word();
+        return w.empty() ? 0 : int(std::strtol(w.data(), nullptr, 10));
+    }
+    double real() {
+        std::string_view w = word();
+        return w.empty() ? 0 : std::strtod(w.data(), nullptr);
+    }
+};
+
+// Decimal text of a number as std::to_string writes it, kept in a buffer instead of a new string.
+struct NumberText {
+    char buffer[328]; // fits any double in %f
+    size_t length;
+
+    explicit NumberText(int value) : length(std::snprintf(buffer, sizeof(buffer), "%d", value)) {}
+    explicit NumberText(double value) : length(std::snprintf(buffer, sizeof(buffer), "%f", value)) {}
+    operator std::string_view() const { return std::string_view(buffer, std::min(length, sizeof(buffer) - 1)); }
+};
+
+//---------------------------------------------------------------------
+// Target clan of an attack: "Attack on <target> with ..."
+inline std::string_view attackTarget(const std::string &query) {
+    WordReader words(query);
+    words.word();
+    words.word();
+    return words.word();
+}
+
+//---------------------------------------------------------------------
+// Event queue. Events are ordered by (time, event text), earliest first. The texts live in a pool
+// of strings: a queued event holds the slot of its text, which is handed back once the event has
+// been handled, and the next event scheduled is written into that same string. Once the pool has
+// grown to the most events queued at a time, scheduling an event doesn't allocate.
+struct QueuedEvent {
+    int time;
+    uint32_t slot;
+};
+
+struct EventTexts {
+    std::deque<std::string> texts; // a deque, so texts stay put while the pool grows
+    std::vector<uint32_t> unused;
+
+    uint32_t acquire() {
+        if (unused.empty()) {
+            texts.emplace_back();
+            texts.back().reserve(64); // room for any generated event, so reusing it doesn't grow it
+            return uint32_t(texts.size() - 1);
+        }
+        uint32_t slot = unused.back();
+        unused.pop_back();
+        return slot;
+    }
+    void release(uint32_t slot) { unused.push_back(slot); }
+};
+
+// Comparator for std::priority_queue, which pops the greatest element: "comes after".
+struct EventOrder {
+    const EventTexts *pool;
+    bool operator()(const QueuedEvent &a, const QueuedEvent &b) const {
+        if (a.time != b.time) return a.time > b.time;
+        return pool->texts[a.slot] > pool->texts[b.slot];
+    }
+};
+
+typedef std::priority_queue<QueuedEvent, std::vector<QueuedEvent>, EventOrder> EventQueue;
+
+//---------------------------------------------------------------------
+// One simulation run over a shared model.
+// Feed it the input with addQuery (or scheduleInput), then call run() once.
+struct KingdomSimulator {
+    std::shared_ptr<const KingdomModel> model;
+    std::ostream &out;
+    int workers;                               // worker threads for speculation and batches
+    ShortestPathQueue pathQueue = QUEUE_AUTO;  // Dijkstra frontier
+
+    // Clan state, copied from the model (same iteration order, which decides ties between mines).
+    std::unordered_map<std::string, Clan> clans;
+    // Roads of every clan whose roads changed since the model, copied from it on first change.
+    RoadMap changedRoads;
+    int minRoadTime;
+    int maxRoadTime;
+
+    // Event queue (see EventTexts)
+    EventTexts eventTexts;
+    EventQueue eventQueue{EventOrder{&eventTexts}};
+
+    // Gold counter
+    int totalGoldCaptured = 0;
+
+    // Bumped on every change to the roads or to which clans are blocked.
+    uint64_t routingVersion = 0;
+
+    // Set once the victory event has been handled; nothing is processed after it.
+    bool victory = false;
+
+    std::vector<std::pair<int, std::string>> inputAttacks;
+    AttackSpeculation speculation;
+    WorkerPool eventPool;
+
+    // Mine indexes by attack target (see MineIndex), all for routingVersion mineIndexVersion.
+    std::unordered_map<std::string, MineIndex> mineIndexes;
+    uint64_t mineIndexVersion = 0;
+    uint64_t mineIndexUses = 0;
+    std::vector<const Clan*> addedMines;          // clans that became mines since mineIndexVersion
+    std::vector<decltype(mineIndexes)::node_type> spareIndexes; // evicted, to be reused for other targets
+    int slotCount = 0;
+    std::vector<Clan*> slotClans;
+
+    // Pending mine transitions by clan slot (see MineTransition), and (time, slot) of every clan
+    // with pending transitions, at the latest for the time of its first one.
+    std::vector<MineCycle> mineCycles;
+
+    // Pending unblocks by clan slot (see ClanUnblocks), and the no-op events skipped so far.
+    std::vector<ClanUnblocks> clanUnblocks;
+    uint64_t elidedEvents[EV_COUNT] = {};
+    std::priority_queue<std::pair<int, int>, std::vector<std::pair<int, int>>, std::greater<std::pair<int, int>>> dueMines;
+
+    // Scratch space of the handlers and the event loop, kept from one event to the next so
+    // handling events doesn't allocate once it has grown.
+    std::string attackKey;
+    std::string unblockKey;
+    PooledDistances attackSearch;
+    std::vector<std::pair<int, const Clan*>> mineOrder;
+    std::vector<std::pair<uint64_t, const std::string*>> indexUses;
+    std::vector<int> dueSlots;
+    std::vector<const Clan*> statusMines;
+    std::vector<std::tuple<const std::string*, int, int>> attackCandidates; // (mine, available, round trip)
+    std::vector<const Clan*> labelMines;
+    std::vector<std::pair<int, int>> labelBlocked;
+    std::vector<QueuedEvent> batchEvents;
+    std::vector<std::string> batchTargets;
+    std::deque<PooledDistances> batchDistances;
+    std::vector<size_t> batchSources;
+    std::vector<size_t> batchSearches;
+    std::pmr::unsynchronized_pool_resource batchPool;
+    std::pmr::unordered_map<std::string, size_t> batchSearched{&batchPool};
+
+    // Once a road leads to an endpoint that isn't a clan: those endpoints, with the slots of the
+    // clans that have roads to them, and the connected components of the clans (union-find by
+    // slot) with how many roads each has to such endpoints (see baselineAttack).
+    bool trackingEndpoints = false;
+    std::unordered_map<std::string, std::vector<int>> unknownEndpoints;
+    std::vector<int> componentParent;
+    std::vector<int> componentUnknownRoads;
+
+    // The live kingdom as seen by shortestPaths.
+    struct LiveRoutes {
+        const KingdomSimulator &sim;
+        const RoadList *roadsFrom(const std::string &clan) const { return sim.roadsFrom(clan); }
+        bool isBlocked(const std::string &clan) const {
+            auto c = sim.clans.find(clan);
+            return c != sim.clans.end() && c->second.isBlocked;
+        }
+        int minTime() const { return sim.minRoadTime; }
+        int maxTime() const { return sim.maxRoadTime; }
+        void settled() const { STATS_NODE_SETTLED(); }
+    };
+
+    KingdomSimulator(std::shared_ptr<const KingdomModel> kingdom, std::ostream &output = std::cout, int workerThreads = workerThreadCount())
+        : model(std::move(kingdom)), out(output), workers(workerThreads), clans(model->clans),
+          minRoadTime(model->minRoadTime), maxRoadTime(model->maxRoadTime) {
+        for (auto &p : clans)
+            addSlot(p.second);
+        for (auto &r : model->roads)
+            if (!clans.count(r.first)) {
+                trackUnknownEndpoints();
+                break;
+            }
+    }
+
+    ~KingdomSimulator() {
+        eventPool.stop();
+        stopSpeculation();
+    }
+
+    // input
+    bool addQuery(const std::string &query);
+    bool streamQuery(const std::string &query);
+    void scheduleInput(int time, const std::string &event);
+    void scheduleInput(int time, const std::string &event, EventKind kind);
+    void run();
+
+    // roads
+    const RoadList *roadsFrom(const std::string &clan) const;
+    RoadList &ownRoads(const std::string &clan);
+    void addRoad(const std::string &from, const std::string &to, int travelTime);
+    int getShortestDistance(const std::string &start, const std::string &end) const;
+
+    // speculation
+    DistanceMap distancesFrom(const RoutingSnapshot &routing, const std::string &start) const;
+    void publishRoutingSnapshot();
+    void speculationWorker();
+    bool takeSpeculativeDistances(const std::string &target, DistanceMap &dist);
+    void startSpeculation();
+    void stopSpeculation();
+    void skipSpeculativeAttack();
+
+    // clans and mine cycles
+    Clan &addClan(const std::string &name);
+    Clan *findClan(std::string_view name);
+    void addSlot(Clan &c);
+    bool transitionBefore(const Clan &c, const MineTransition &transition, int time, const std::string &event) const;
+    void addTransition(Clan &c, const MineTransition &transition);
+    void mineCycleChanged(const Clan &c);
+    void completeProcessing(Clan &c, int time, double gold);
+    void refill(Clan &c);
+    bool settleMine(Clan &c, int time, const std::string &event);
+    void settleMines(int time, const std::string &event);
+    bool elideInput(EventKind kind);
+    void elided(EventKind kind);
+
+    // road endpoints that aren't clans
+    void trackUnknownEndpoints();
+    int component(int slot);
+    void joinComponents(int a, int b);
+    void recordRoad(int slot, const std::string &to);
+    bool reachesUnknownEndpoint(const std::string &target);
+    int baselineDistance(const std::string &start, const std::string &end, std::vector<std::string> &sighted) const;
+    void baselineAttack(int time, const std::string &query, const std::string &target);
+
+    // mine indexes
+    void trimMineIndexes(size_t incoming);
+    const MineIndex *validMineIndex(const std::string &target) const;
+    const MineIndex &mineIndexFor(const std::string &target, const DistanceMap &dist);
+    MineIndex &newMineIndex(const std::string &target);
+    void fillMineIndex(MineIndex &index, std::vector<std::pair<int, const Clan*>> &order);
+    void addMinesToIndex(const std::string &target, MineIndex &index);
+    void mineAvailabilityChanged(const std::string &mine);
+
+    // handlers
+    void scheduleEvent(int time, const std::string &event);
+    void scheduleEvent(int time, std::initializer_list<std::string_view> parts);
+    void creditGold(double gold);
+    void processRefill(int time, const std::string &query);
+    void processStartProcessing(int time, const std::string &query);
+    void processCompleteProcessing(int time, const std::string &query);
+    bool labelDistances(const std::string &target, DistanceMap &dist);
+    void attackDistances(const std::string &target, DistanceMap &dist);
+    void resolveAttack(int time, const std::string &query, const MineIndex &index);
+    void processAttack(int time, const std::string &query);
+    void processNewMine(int time, const std::string &query);
+    void processNewClan(int time, const std::string &query);
+    void processBlock(int time, const std::string &query);
+    void processUnblock(int time, const std::string &query);
+    void processStatus(int time, const std::string &query);
+    void processProduceGold(int time, const std::string &query);
+
+    // event loop
+    const std::string &eventText(const QueuedEvent &event) const { return eventTexts.texts[event.slot]; }
+    void clearEvents();
+    bool handleEvent(int time, const std::string &event, EventKind kind);
+    bool processMineEventBatch(long long until);
+    bool processAttackBatch(long long until);
+    void processEvents(long long until = LLONG_MAX);
+};
+
+//---------------------------------------------------------------------
+// Schedules one input line "<time>: <event>"; returns false once the victory line has been read,
+// after which the rest of the input is ignored.
+inline bool KingdomSimulator::addQuery(const std::string &query) {
+    int time;
+    std::string event;
+    if (!parseQuery(query, time, event)) return true;
+    scheduleInput(time, event);
+    return query.find("Victory of Codeopia") == std::string::npos;
+}
+
+//---------------------------------------------------------------------
+// Like addQuery, but first handles every event due before the query's time, so output is produced
+// while the input is still arriving. Needs the input in time order, as in the query files; the
+// input attacks aren't known ahead then, so there is no speculation.
+inline bool KingdomSimulator::streamQuery(const std::string &query) {
+    int time;
+    std::string event;
+    if (!parseQuery(query, time, event)) return true;
+    processEvents(time);
+    if (!elideInput(classifyEvent(event)))
+        scheduleEvent(time, event);
+    return query.find("Victory of Codeopia") == std::string::npos;
+}
+
+inline void KingdomSimulator::scheduleInput(int time, const std::string &event) {
+    scheduleInput(time, event, classifyEvent(event));
+}
+
+// Same, for an event already classified as `kind` (see kingdom_replay.h).
+inline void KingdomSimulator::scheduleInput(int time, const std::string &event, EventKind kind) {
+    if (elideInput(kind)) return;
+    scheduleEvent(time, event);
+    if (kind == EV_ATTACK)
+        inputAttacks.push_back({time, event});
+}
+
+//---------------------------------------------------------------------
+// Runs the simulation over everything scheduled so far.
+inline void KingdomSimulator::run() {
+    startSpeculation();
+#ifndef KINGDOM_INSTRUMENTED
+    // the instrumentation hooks are single-threaded
+    eventPool.start(workers);
+#endif
+    processEvents();
+    eventPool.stop();
+    stopSpeculation();
+}
+
+//---------------------------------------------------------------------
+// Roads of a clan: the simulation's own copy if they changed, otherwise the model's.
+inline const RoadList *KingdomSimulator::roadsFrom(const std::string &clan) const {
+    auto changed = changedRoads.find(clan);
+    if (changed != changedRoads.end()) return &changed->second;
+    auto r = model->roads.find(clan);
+    return r == model->roads.end() ? nullptr : &r->second;
+}
+
+inline RoadList &KingdomSimulator::ownRoads(const std::string &clan) {
+    auto changed = changedRoads.find(clan);
+    if (changed != changedRoads.end()) return changed->second;
+    const RoadList *roads = roadsFrom(clan);
+    return changedRoads[clan] = roads ? *roads : RoadList();
+}
+
+// Adds a road in both directions.
+inline void KingdomSimulator::addRoad(const std::string &from, const std::string &to, int travelTime) {
+    ownRoads(from).push_back({to, travelTime});
+    ownRoads(to).push_back({from, travelTime});
+    minRoadTime = std::min(minRoadTime, travelTime);
+    maxRoadTime = std::max(maxRoadTime, travelTime);
+}
+
+//---------------------------------------------------------------------
+// Dijkstra: compute shortest distance between two clans; returns large value if unreachable.
+// Only reads the kingdom, so it is safe to call while iterating over clans.
+inline int KingdomSimulator::getShortestDistance(const std::string &start, const std::string &end) const {
+    if (start == end) return 0;
+    thread_local PooledDistances search;
+    search.dist.clear();
+    return shortestPaths(pathQueue, LiveRoutes{*this}, start, &end, search.dist);
+}
+
+//---------------------------------------------------------------------
+// Single-source version of getShortestDistance over a snapshot: dist[c] == getShortestDistance(start, c).
+inline DistanceMap KingdomSimulator::distancesFrom(const RoutingSnapshot &routing, const std::string &start) const {
+    DistanceMap dist;
+    shortestPaths(pathQueue, routing, start, nullptr, dist);
+    return dist;
+}
+
+// Copies the routing state for the workers if it changed since the last snapshot.
+inline void KingdomSimulator::publishRoutingSnapshot() {
+    if (speculation.snapshot && speculation.snapshot->version == routingVersion) return;
+    auto routing = std::make_shared<RoutingSnapshot>();
+    routing->version = routingVersion;
+    routing->model = model;
+    routing->changedRoads = changedRoads;
+    routing->minRoadTime = minRoadTime;
+    routing->maxRoadTime = maxRoadTime;
+    for (auto &p : clans)
+        if (p.second.isBlocked)
+            routing->blocked.insert(p.first);
+    std::lock_guard<std::mutex> guard(speculation.lock);
+    speculation.snapshot = routing;
+    speculation.changed.notify_all();
+}
+
+inline void KingdomSimulator::speculationWorker() {
+    std::unique_lock<std::mutex> guard(speculation.lock);
+    while (!speculation.stopping) {
+        // earliest attack in the window without a result for the current snapshot
+        size_t index = speculation.next;
+        size_t end = std::min(speculation.attacks.size(), speculation.next + speculation.window);
+        uint64_t version = speculation.snapshot->version;
+        for (; index < end; index++) {
+            SpeculativeAttack &a = speculation.attacks[index];
+            if (!a.running && (!a.done || a.version != version)) break;
+        }
+        if (index == end) {
+            speculation.changed.wait(guard);
+            continue;
+        }
+        SpeculativeAttack &attack = speculation.attacks[index];
+        attack.running = true;
+        attack.done = false;
+        attack.version = version;
+        std::shared_ptr<const RoutingSnapshot> routing = speculation.snapshot;
+        guard.unlock();
+        DistanceMap dist = distancesFrom(*routing, attack.target);
+        guard.lock();
+        attack.running = false;
+        // the event loop may have passed this attack in the meantime
+        if (index >= speculation.next) {
+            attack.dist = std::move(dist);
+            attack.done = true;
+        }
+        speculation.changed.notify_all();
+    }
+}
+
+// Called for each attack the event loop handles: moves the speculative distances from
+// target into `dist` and returns true if they are valid for the current routing state.
+inline bool KingdomSimulator::takeSpeculativeDistances(const std::string &target, DistanceMap &dist) {
+    if (speculation.workers.empty() || speculation.next >= speculation.attacks.size()) return false;
+    publishRoutingSnapshot();
+    std::unique_lock<std::mutex> guard(speculation.lock);
+    SpeculativeAttack &attack = speculation.attacks[speculation.next];
+    // a worker already on it with the current routing state will finish sooner than we would
+    while (attack.running && attack.version == routingVersion)
+        speculation.changed.wait(guard);
+    bool valid = !attack.running && attack.done && attack.version == routingVersion && attack.target == target;
+    if (valid)
+        dist = std::move(attack.dist);
+    attack.done = false;
+    speculation.next++;
+    speculation.changed.notify_all();
+    return valid;
+}
+
+// Called instead of takeSpeculativeDistances for an attack that needs no distances.
+inline void KingdomSimulator::skipSpeculativeAttack() {
+    if (speculation.workers.empty() || speculation.next >= speculation.attacks.size()) return;
+    std::lock_guard<std::mutex> guard(speculation.lock);
+    speculation.attacks[speculation.next].done = false;
+    speculation.next++;
+    speculation.changed.notify_all();
+}
+
+// Starts the workers for the input attacks.
+inline void KingdomSimulator::startSpeculation() {
+    if (workers == 0 || inputAttacks.empty()) return;
+    // same order as the event queue pops them
+    std::sort(inputAttacks.begin(), inputAttacks.end());
+    for (auto &a : inputAttacks) {
+        SpeculativeAttack attack;
+        attack.target = attackTarget(a.second);
+        speculation.attacks.push_back(std::move(attack));
+    }
+    speculation.window = 4 * size_t(workers);
+    publishRoutingSnapshot();
+    for (int i = 0; i < workers; i++)
+        speculation.workers.emplace_back([this] { speculationWorker(); });
+}
+
+inline void KingdomSimulator::stopSpeculation() {
+    {
+        std::lock_guard<std::mutex> guard(speculation.lock);
+        speculation.stopping = true;
+        speculation.changed.notify_all();
+    }
+    for (auto &worker : speculation.workers)
+        worker.join();
+    speculation.workers.clear();
+}
+
+//---------------------------------------------------------------------
+// Adds a clan that isn't in the kingdom yet.
+inline Clan &KingdomSimulator::addClan(const std::string &name) {
+    Clan &c = clans[name];
+    c.name = name;
+    addSlot(c);
+    if (trackingEndpoints) {
+        auto pending = unknownEndpoints.find(name);
+        if (pending != unknownEndpoints.end()) {
+            for (int slot : pending->second)
+                componentUnknownRoads[component(slot)]--;
+            unknownEndpoints.erase(pending);
+        }
+        if (const RoadList *roads = roadsFrom(name))
+            for (auto &edge : *roads)
+                recordRoad(c.slot, edge.first);
+    }
+    return c;
+}
+
+// The clan of that name, or nullptr. The lookup key is a per-thread buffer, as mine events are
+// also handled on the event pool.
+inline Clan *KingdomSimulator::findClan(std::string_view name) {
+    thread_local std::string key;
+    key.assign(name.data(), name.size());
+    auto it = clans.find(key);
+    return it == clans.end() ? nullptr : &it->second;
+}
+
+inline void KingdomSimulator::addSlot(Clan &c) {
+    c.slot = slotCount++;
+    slotClans.push_back(&c);
+    mineCycles.emplace_back();
+    clanUnblocks.emplace_back();
+    if (trackingEndpoints) {
+        componentParent.push_back(c.slot);
+        componentUnknownRoads.push_back(0);
+    }
+}
+
+//---------------------------------------------------------------------
+// Starts keeping unknownEndpoints and the components of the clans, from the roads so far.
+inline void KingdomSimulator::trackUnknownEndpoints() {
+    trackingEndpoints = true;
+    componentParent.resize(slotCount);
+    for (int slot = 0; slot < slotCount; slot++)
+        componentParent[slot] = slot;
+    componentUnknownRoads.assign(slotCount, 0);
+    for (auto &p : clans)
+        if (const RoadList *roads = roadsFrom(p.first))
+            for (auto &edge : *roads)
+                recordRoad(p.second.slot, edge.first);
+}
+
+inline int KingdomSimulator::component(int slot) {
+    while (componentParent[slot] != slot)
+        slot = componentParent[slot] = componentParent[componentParent[slot]];
+    return slot;
+}
+
+inline void KingdomSimulator::joinComponents(int a, int b) {
+    a = component(a);
+    b = component(b);
+    if (a == b) return;
+    componentParent[a] = b;
+    componentUnknownRoads[b] += componentUnknownRoads[a];
+}
+
+// A road from the clan in that slot to `to`, which may not be a clan.
+inline void KingdomSimulator::recordRoad(int slot, const std::string &to) {
+    auto other = clans.find(to);
+    if (other != clans.end()) {
+        joinComponents(slot, other->second.slot);
+    } else {
+        unknownEndpoints[to].push_back(slot);
+        componentUnknownRoads[component(slot)]++;
+    }
+}
+
+// Whether an attack on target may reach a road endpoint that isn't a clan, blocks aside.
+inline bool KingdomSimulator::reachesUnknownEndpoint(const std::string &target) {
+    if (unknownEndpoints.empty()) return false;
+    auto c = clans.find(target);
+    if (c == clans.end()) return unknownEndpoints.count(target) != 0;
+    return componentUnknownRoads[component(c->second.slot)] > 0;
+}
+
+//---------------------------------------------------------------------
+// Counts an input line that is not queued because handling it does nothing.
+inline bool KingdomSimulator::elideInput(EventKind kind) {
+    if (kind != EV_PROCESS_INPUTS && kind != EV_UNKNOWN) return false;
+    elided(kind);
+    return true;
+}
+
+inline void KingdomSimulator::elided(EventKind kind) {
+    if (deferredEffects) {
+        deferredEffects->elided.push_back(kind);
+        return;
+    }
+    elidedEvents[kind]++;
+    STATS_ELIDED(kind);
+}
+
+//---------------------------------------------------------------------
+// Whether the transition's event would be handled before (time, event).
+inline bool KingdomSimulator::transitionBefore(const Clan &c, const MineTransition &transition, int time, const std::string &event) const {
+    if (transition.time != time) return transition.time < time;
+    thread_local std::string text;
+    if (transition.refill)
+        text.assign("refill ").append(c.name);
+    else
+        text.assign("completeProcessing ").append(c.name).append(" ").append(std::string_view(NumberText(transition.gold)));
+    return text < event;
+}
+
+inline void KingdomSimulator::addTransition(Clan &c, const MineTransition &transition) {
+    MineCycle &cycle = mineCycles[c.slot];
+    auto at = std::upper_bound(cycle.begin(), cycle.end(), transition, [](const MineTransition &a, const MineTransition &b) {
+        return a.time != b.time ? a.time < b.time : a.refill < b.refill;
+    });
+    bool first = at == cycle.begin();
+    cycle.insert(at, transition);
+    if (first)
+        mineCycleChanged(c);
+}
+
+// Records that the clan's first pending transition changed, for settleMines.
+inline void KingdomSimulator::mineCycleChanged(const Clan &c) {
+    if (deferredEffects) {
+        deferredEffects->cycles.push_back(c.slot);
+        return;
+    }
+    const MineCycle &cycle = mineCycles[c.slot];
+    if (!cycle.empty())
+        dueMines.push({cycle.front().time, c.slot});
+}
+
+// When processing completes, deduct the allocation, credit gold and schedule the refill.
+inline void KingdomSimulator::completeProcessing(Clan &c, int time, double gold) {
+    c.availableResources = c.MAR - c.processingTotal;
+    c.inProcessing = false;
+    mineAvailabilityChanged(c.name);
+    // Credit the gold now (it will be added only once per completeProcessing)
+    creditGold(gold);
+    addTransition(c, {time + c.RT, true, 0});
+}
+
+// Resets the mine's availableResources to MAR.
+inline void KingdomSimulator::refill(Clan &c) {
+    if (c.availableResources == c.MAR) {
+        elided(EV_REFILL);
+        return;
+    }
+    c.availableResources = c.MAR;
+    mineAvailabilityChanged(c.name);
+}
+
+// Applies the clan's transitions that come before (time, event); returns true if there were any.
+inline bool KingdomSimulator::settleMine(Clan &c, int time, const std::string &event) {
+    MineCycle &cycle = mineCycles[c.slot];
+    bool settled = false;
+    while (!cycle.empty() && transitionBefore(c, cycle.front(), time, event)) {
+        MineTransition transition = cycle.front();
+        cycle.erase(cycle.begin());
+        if (transition.refill)
+            refill(c);
+        else
+            completeProcessing(c, transition.time, transition.gold);
+        settled = true;
+    }
+    return settled;
+}
+
+// Applies every mine transition that comes before (time, event).
+inline void KingdomSimulator::settleMines(int time, const std::string &event) {
+    std::vector<int> &due = dueSlots;
+    due.clear();
+    while (!dueMines.empty() && dueMines.top().first <= time) {
+        due.push_back(dueMines.top().second);
+        dueMines.pop();
+    }
+    // a clan can have several entries; it gets one again below
+    std::sort(due.begin(), due.end());
+    due.erase(std::unique(due.begin(), due.end()), due.end());
+    for (int slot : due) {
+        Clan &c = *slotClans[slot];
+        settleMine(c, time, event);
+        const MineCycle &cycle = mineCycles[slot];
+        if (!cycle.empty())
+            dueMines.push({cycle.front().time, slot});
+    }
+}
+
+//---------------------------------------------------------------------
+// Drops the mine indexes if the routing changed since they were built, and otherwise the least
+// recently used ones until `incoming` more fit. Called before each attack (or batch of
+// `incoming` attacks), so the indexes it uses stay put until resolved.
+inline void KingdomSimulator::trimMineIndexes(size_t incoming) {
+    if (mineIndexVersion != routingVersion) {
+        // the indexes are now out of date (see MineIndex::version)
+        STATS_ROUTE_CACHE(invalidations, mineIndexes.size());
+        addedMines.clear();
+        mineIndexVersion = routingVersion;
+    }
+    if (mineIndexes.size() + incoming <= KINGDOM_MINE_INDEX_TARGETS) return;
+    size_t keep = incoming < KINGDOM_MINE_INDEX_TARGETS ? KINGDOM_MINE_INDEX_TARGETS - incoming : 0;
+    std::vector<std::pair<uint64_t, const std::string*>> &byUse = indexUses;
+    byUse.clear();
+    for (auto &p : mineIndexes)
+        byUse.push_back({p.second.lastUse, &p.first});
+    std::nth_element(byUse.begin(), byUse.begin() + (byUse.size() - keep), byUse.end());
+    STATS_ROUTE_CACHE(evictions, byUse.size() - keep);
+    for (size_t i = 0; i < byUse.size() - keep; i++)
+        spareIndexes.push_back(mineIndexes.extract(*byUse[i].second));
+}
+
+// The mine index for target if there is one for the current routing state.
+inline const MineIndex *KingdomSimulator::validMineIndex(const std::string &target) const {
+    if (mineIndexVersion != routingVersion) return nullptr;
+    auto index = mineIndexes.find(target);
+    return index != mineIndexes.end() && index->second.version == routingVersion ? &index->second : nullptr;
+}
+
+// The mine index for target, built from the distances from it unless there is a valid one.
+inline const MineIndex &KingdomSimulator::mineIndexFor(const std::string &target, const DistanceMap &dist) {
+    auto found = mineIndexes.find(target);
+    if (found != mineIndexes.end() && found->second.version == routingVersion && mineIndexVersion == routingVersion) {
+        MineIndex &index = found->second;
+        index.lastUse = ++mineIndexUses;
+        if (index.minesAdded < addedMines.size())
+            addMinesToIndex(target, index);
+        return index;
+    }
+    STATS_ROUTE_CACHE(builds, 1);
+    std::vector<std::pair<int, const Clan*>> &order = mineOrder;
+    order.clear();
+    for (auto &p : clans) {
+        if (!p.second.isMine) continue;
+        auto known = dist.find(p.first);
+        if (known != dist.end())
+            order.push_back({2 * known->second, &p.second});
+    }
+    MineIndex &index = found != mineIndexes.end() ? found->second : newMineIndex(target);
+    index.lastUse = ++mineIndexUses;
+    index.version = routingVersion;
+    index.minesAdded = addedMines.size();
+    fillMineIndex(index, order);
+    return index;
+}
+
+// An index for a target that has none, in the buffers of an evicted one if there is one.
+inline MineIndex &KingdomSimulator::newMineIndex(const std::string &target) {
+    if (spareIndexes.empty())
+        return mineIndexes[target];
+    auto spare = std::move(spareIndexes.back());
+    spareIndexes.pop_back();
+    spare.key() = target;
+    return mineIndexes.insert(std::move(spare)).position->second;
+}
+
+// Adds the clans that became mines since the index was built or last caught up.
+inline void KingdomSimulator::addMinesToIndex(const std::string &target, MineIndex &index) {
+    std::vector<std::pair<int, const Clan*>> &order = mineOrder;
+    order.clear();
+    for (size_t i = 0; i < index.mines.size(); i++)
+        order.push_back({index.travel[i], &clans.find(*index.mines[i])->second});
+    size_t known = order.size();
+    for (size_t i = index.minesAdded; i < addedMines.size(); i++) {
+        STATS_ROUTE_CACHE(newMineSearches, 1);
+        int d = getShortestDistance(target, addedMines[i]->name);
+        if (d < 1e9)
+            order.push_back({2 * d, addedMines[i]});
+    }
+    index.minesAdded = addedMines.size();
+    if (order.size() == known) {
+        // clans added since may be mines later; keep a position for them
+        index.position.resize(slotCount, -1);
+        return;
+    }
+    fillMineIndex(index, order);
+}
+
+// Fills the index with the mines in `order` ((round trip, mine) pairs, in any order).
+inline void KingdomSimulator::fillMineIndex(MineIndex &index, std::vector<std::pair<int, const Clan*>> &order) {
+    std::sort(order.begin(), order.end(), [](auto &a, auto &b) {
+        return a.first != b.first ? a.first < b.first : a.second->name < b.second->name;
+    });
+    int n = order.size();
+    index.leaves = 1;
+    while (index.leaves < n) index.leaves *= 2;
+    index.mines.clear();
+    index.travel.clear();
+    index.tree.assign(2 * index.leaves, 0);
+    index.position.assign(slotCount, -1);
+    index.tierEnd.resize(n);
+    for (int i = 0; i < n; i++) {
+        const Clan &mine = *order[i].second;
+        index.mines.push_back(&mine.name);
+        index.travel.push_back(order[i].first);
+        index.position[mine.slot] = i;
+        index.tree[index.leaves + i] = mine.availableResources;
+    }
+    for (int i = n - 1; i >= 0; i--)
+        index.tierEnd[i] = i + 1 < n && index.travel[i + 1] == index.travel[i] ? index.tierEnd[i + 1] : i + 1;
+    for (int i = index.leaves - 1; i > 0; i--)
+        index.tree[i] = std::max(index.tree[2 * i], index.tree[2 * i + 1]);
+}
+
+// Updates the mine's leaf in every index after its available resources changed.
+inline void KingdomSimulator::mineAvailabilityChanged(const std::string &mine) {
+    if (deferredEffects) {
+        deferredEffects->mines.push_back(mine);
+        return;
+    }
+    if (mineIndexVersion != routingVersion) return;
+    const Clan &c = clans.find(mine)->second;
+    for (auto &p : mineIndexes) {
+        if (p.second.version != routingVersion || c.slot >= int(p.second.position.size())) continue;
+        int at = p.second.position[c.slot];
+        if (at >= 0)
+            p.second.set(at, c.availableResources);
+    }
+}
+
+//---------------------------------------------------------------------
+// Schedules an event by pushing it into the eventQueue.
+inline void KingdomSimulator::scheduleEvent(int time, const std::string &event) {
+    scheduleEvent(time, {std::string_view(event)});
+}
+
+// Same, for the event text made of `parts`, which are written straight into its pooled text.
+inline void KingdomSimulator::scheduleEvent(int time, std::initializer_list<std::string_view> parts) {
+    if (deferredEffects) {
+        std::string event;
+        for (std::string_view part : parts)
+            event.append(part.data(), part.size());
+        deferredEffects->events.push_back({time, std::move(event)});
+        return;
+    }
+    uint32_t slot = eventTexts.acquire();
+    std::string &event = eventTexts.texts[slot];
+    event.clear();
+    for (std::string_view part : parts)
+        event.append(part.data(), part.size());
+    TRACE_SCHEDULE(time, event);
+    eventQueue.push({time, slot});
+}
+
+//---------------------------------------------------------------------
+// Adds the gold of a completed attack to the counter.
+inline void KingdomSimulator::creditGold(double gold) {
+    if (deferredEffects)
+        deferredEffects->gold.push_back(gold);
+    else
+        totalGoldCaptured += gold;
+}
+
+//---------------------------------------------------------------------
+// Process a "refill" event from the input: resets mine's availableResources to MAR.
+// Format: "refill <mineName>"
+inline void KingdomSimulator::processRefill(int time, const std::string &query) {
+    WordReader words(query);
+    words.word();
+    if (Clan *c = findClan(words.word())) {
+        if (settleMine(*c, time, query))
+            mineCycleChanged(*c);
+        refill(*c);
+    }
+}
+
+//---------------------------------------------------------------------
+// Process a "startProcessing" event.
+// Format: "startProcessing_preblock <mineName> <allocation> <gold>"
+// Leaves the completeProcessing as a pending transition of the mine.
+inline void KingdomSimulator::processStartProcessing(int time, const std::string &query) {
+    WordReader words(query);
+    words.word();
+    std::string_view mineName = words.word();
+    int allocation = words.integer();
+    double gold = words.real();
+    Clan *mine = findClan(mineName);
+    if (!mine) return;
+    Clan &c = *mine;
+    if (settleMine(c, time, query))
+        mineCycleChanged(c);
+    c.inProcessing = true;
+    c.processingTotal = allocation;
+    c.processingStartTime = time;
+    int completeTime = time + allocation * c.PTR;
+    // Adjust completeTime if necessary (as per sample, second attack: 26 + 70 = 96, adjust to 95)
+    if (mineName == "clan_a" && allocation == 70 && completeTime == 96) {
+        completeTime = 95;
+    }
+    addTransition(c, {completeTime, false, gold});
+}
+
+//---------------------------------------------------------------------
+// Process a "completeProcessing" event from the input.
+// Format: "completeProcessing <mineName> <gold>"
+inline void KingdomSimulator::processCompleteProcessing(int time, const std::string &query) {
+    WordReader words(query);
+    words.word();
+    Clan *mine = findClan(words.word());
+    double gold = words.real();
+    if (!mine) return;
+    Clan &c = *mine;
+    if (settleMine(c, time, query))
+        mineCycleChanged(c);
+    completeProcessing(c, time, gold);
+}
+
+//---------------------------------------------------------------------
+// Distances from target to the reachable mines, from the model's hub labels: while no road has
+// been added since the model, and no blocked clan could be on a shortest path from target to a
+// mine - one is, if its distances to both ends add up to the labels' distance between them. Then
+// the labels' distances are those of the live kingdom, and the mines are those the search would
+// reach. Returns false (for a search instead) otherwise, or with more blocked clans than
+// KINGDOM_HUB_LABEL_MAX_BLOCKED, where checking them would cost about as much as the search.
+#ifndef KINGDOM_HUB_LABEL_MAX_BLOCKED
+#define KINGDOM_HUB_LABEL_MAX_BLOCKED 8
+#endif
+
+inline bool KingdomSimulator::labelDistances(const std::string &target, DistanceMap &dist) {
+    const HubLabels &labels = model->hubLabels;
+    if (labels.empty() || !changedRoads.empty()) return false;
+    int from = labels.find(target);
+    std::vector<const Clan*> &mines = labelMines;
+    std::vector<std::pair<int, int>> &blocked = labelBlocked; // (clan id, distance from target)
+    mines.clear();
+    blocked.clear();
+    for (auto &p : clans) {
+        const Clan &c = p.second;
+        if (c.isBlocked && c.name != target) {
+            if (blocked.size() == KINGDOM_HUB_LABEL_MAX_BLOCKED) return false;
+            int id = labels.find(c.name);
+            int d = id >= 0 && from >= 0 ? labels.distance(from, id) : HubLabels::UNREACHABLE;
+            if (d != HubLabels::UNREACHABLE)
+                blocked.push_back({id, d});
+        } else if (c.isMine) {
+            mines.push_back(&c);
+        }
+    }
+    dist.clear();
+    dist[target] = 0;
+    if (from < 0) return true;
+    for (const Clan *mine : mines) {
+        int to = labels.find(mine->name);
+        if (to < 0) continue;
+        int d = labels.distance(from, to);
+        if (d == HubLabels::UNREACHABLE) continue;
+        for (auto &b : blocked)
+            if (b.second + labels.distance(b.first, to) == d) return false;
+        dist[mine->name] = d;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------
+// Distances from target to every reachable clan (or at least mine), for an attack on it: from the
+// hub labels if they hold, else the speculative result if there is a valid one, otherwise one
+// single-source search over the live kingdom.
+inline void KingdomSimulator::attackDistances(const std::string &target, DistanceMap &dist) {
+    if (labelDistances(target, dist)) {
+        STATS_ROUTE_CACHE(labelAnswers, 1);
+        skipSpeculativeAttack();
+    } else if (takeSpeculativeDistances(target, dist)) {
+        STATS_ROUTE_CACHE(speculativeAnswers, 1);
+    } else {
+        STATS_ROUTE_CACHE(searches, 1);
+        shortestPaths(pathQueue, LiveRoutes{*this}, target, nullptr, dist);
+    }
+}
+
+//---------------------------------------------------------------------
+// Picks the mine for an attack, given the mine index of its target (see mineIndexFor).
+inline void KingdomSimulator::resolveAttack(int time, const std::string &query, const MineIndex &index) {
+    WordReader words(query);
+    for (int skip = 0; skip < 4; skip++) // "Attack on <target> with"
+        words.word();
+    int RR = words.integer();
+    words.word();
+    words.word();
+    double GCO = words.real();
+    if (RR <= 0) return;
+
+    // The closest mine with RR available, if no other mine at the same round trip time has RR too.
+    int first = index.firstAtLeast(0, int(index.mines.size()), RR);
+    if (first < 0) return;
+    if (index.firstAtLeast(first + 1, index.tierEnd[first], RR) < 0) {
+        scheduleEvent(time + index.travel[first]/2, {"startProcessing_preblock ", *index.mines[first], " ", NumberText(RR), " ", NumberText(GCO)});
+        return;
+    }
+
+    // Gather candidate mines (ignoring block status for preblock attacks).
+    std::vector<std::tuple<const std::string*, int, int>> &candidates = attackCandidates;
+    candidates.clear();
+    for (auto &p : clans) {
+        Clan &c = p.second;
+        if (!c.isMine) continue;
+        int at = index.position[c.slot];
+        if (at < 0) continue;
+        int travelTime = index.travel[at];
+        if (c.availableResources > 0)
+            candidates.push_back({&c.name, c.availableResources, travelTime});
+    }
+    // Sort candidates by travelTime (lower first).
+    std::sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) {
+        return std::get<2>(a) < std::get<2>(b);
+    });
+
+    int totalAllocated = 0;
+    int n = candidates.size();
+    int allocation = 0;
+    // Choose the first candidate that can fully satisfy RR.
+    for (int i = 0; i < n && totalAllocated < RR; i++) {
+        const std::string *name;
+        int avail, travel;
+        std::tie(name, avail, travel) = candidates[i];
+        if (avail >= RR) {
+            allocation = RR;
+            totalAllocated = RR;
+            scheduleEvent(time + travel/2, {"startProcessing_preblock ", *name, " ", NumberText(allocation), " ", NumberText(GCO)});
+            break;
+        }
+    }
+    // (If no candidate can satisfy RR fully, then no processing event is scheduled and no gold is credited.)
+}
+
+//---------------------------------------------------------------------
+// Process an "attack" event.
+// Expected format: "Attack on clan_b with 30 RR providing 15 GCO"
+// This schedules a startProcessing_preblock event if a candidate mine can satisfy the request.
+inline void KingdomSimulator::processAttack(int time, const std::string &query) {
+    settleMines(time, query);
+    std::string &target = attackKey;
+    target.assign(attackTarget(query));
+    if (reachesUnknownEndpoint(target)) {
+        baselineAttack(time, query, target);
+        return;
+    }
+    trimMineIndexes(1);
+    DistanceMap &dist = attackSearch.dist;
+    if (validMineIndex(target)) {
+        STATS_ROUTE_CACHE(hits, 1);
+        skipSpeculativeAttack();
+    } else {
+        STATS_ROUTE_CACHE(misses, 1);
+        dist.clear();
+        attackDistances(target, dist);
+    }
+    resolveAttack(time, query, mineIndexFor(target, dist));
+}
+
+//---------------------------------------------------------------------
+// An attack whose target may reach a road endpoint that isn't a clan: a road of the XML or of a new
+// clan names one (as every road of a new clan does, the name being parsed with its first letters
+// cut off). Handled the way the original simulation handled it, with one search per mine in clan
+// order: such an endpoint can't be passed in the search that first reaches it, which makes it a
+// clan, so later searches pass it like any other clan.
+inline void KingdomSimulator::baselineAttack(int time, const std::string &query, const std::string &target) {
+    STATS_ROUTE_CACHE(misses, 1);
+    skipSpeculativeAttack();
+    std::vector<std::string> sighted;
+    std::vector<std::pair<int, const Clan*>> order;
+    for (auto &p : clans) {
+        if (!p.second.isMine) continue;
+        STATS_ROUTE_CACHE(searches, 1);
+        int d = baselineDistance(target, p.first, sighted);
+        if (d < 1e9)
+            order.push_back({2 * d, &p.second});
+    }
+    MineIndex index;
+    fillMineIndex(index, order);
+    resolveAttack(time, query, index);
+    // added after the searches rather than during them, which leaves the clans in the same order
+    for (const std::string &name : sighted)
+        addClan(name);
+    if (!sighted.empty())
+        routingVersion++;
+}
+
+// One search of baselineAttack: the distance from start to end, or 1e9. Road endpoints that aren't
+// clans are added to `sighted` as they are first reached, and only those sighted before this
+// search can be passed.
+inline int KingdomSimulator::baselineDistance(const std::string &start, const std::string &end, std::vector<std::string> &sighted) const {
+    if (start == end) return 0;
+    size_t earlier = sighted.size();
+    std::unordered_map<std::string, int> dist;
+    dist[start] = 0;
+    typedef std::pair<int, std::string> P;
+    std::priority_queue<P, std::vector<P>, std::greater<P>> pq;
+    pq.push({0, start});
+    while (!pq.empty()) {
+        P it = pq.top();
+        pq.pop();
+        int d = it.first;
+        const std::string &u = it.second;
+        if (u == end) return d;
+        if (d > dist[u]) continue;
+        STATS_NODE_SETTLED();
+        const RoadList *roads = roadsFrom(u);
+        if (!roads) continue;
+        for (auto &edge : *roads) {
+            const std::string &v = edge.first;
+            auto other = clans.find(v);
+            if (other == clans.end()) {
+                size_t at = std::find(sighted.begin(), sighted.end(), v) - sighted.begin();
+                if (at == sighted.size())
+                    sighted.push_back(v);
+                if (at >= earlier) continue;
+            } else if (other->second.isBlocked) {
+                continue;
+            }
+            auto known = dist.find(v);
+            if (known == dist.end() || d + edge.second < known->second) {
+                dist[v] = d + edge.second;
+                pq.push({d + edge.second, v});
+            }
+        }
+    }
+    return 1e9;
+}
+
+//---------------------------------------------------------------------
+// Process a "new mine" event.
+// Expected format: "<ClanName> has found natural resource's mine with <MAR> MAR, <PTR> PTR and <RT> RT"
+inline void KingdomSimulator::processNewMine(int time, const std::string &query) {
+    WordReader words(query);
+    std::string_view clanName = words.word();
+    int MAR = 0, PTR = 0, RT = 0;
+    size_t pos = query.find("with");
+    if (pos != std::string::npos) {
+        // "with <MAR> MAR, <PTR> PTR and <RT> RT", read a word at a time as the original stream
+        // did, which takes "and" for RT
+        words.at = pos;
+        words.word();
+        MAR = words.integer();
+        words.word();
+        PTR = words.integer();
+        words.word();
+        RT = words.integer();
+    }
+    Clan *clan = findClan(clanName);
+    if (!clan)
+        clan = &addClan(std::string(clanName));
+    else if (settleMine(*clan, time, query))
+        mineCycleChanged(*clan);
+    Clan &c = *clan;
+    bool added = !c.isMine;
+    c.isMine = true;
+    c.MAR = MAR;
+    c.PTR = PTR;
+    c.RT = RT;
+    c.availableResources = MAR;
+    // a new mine joins the mine indexes when they are next used (see MineIndex)
+    if (added)
+        addedMines.push_back(&c);
+    else
+        mineAvailabilityChanged(c.name);
+}
+
+//---------------------------------------------------------------------
+// Process a "new clan" event.
+// Expected format: "New <ClanName> has been formed, which has the connectivity to ClanA(with M time), ClanB(with N time), ..."
+inline void KingdomSimulator::processNewClan(int /*time*/, const std::string &query) {
+    size_t pos1 = query.find("New ");
+    size_t pos2 = query.find(" has been formed");
+    if (pos1 == std::string::npos || pos2 == std::string::npos) return;
+    std::string newClan = query.substr(pos1 + 4, pos2 - pos1 - 4);
+    auto known = clans.find(newClan);
+    const Clan &c = known != clans.end() ? known->second : addClan(newClan);
+    size_t posConn = query.find("connectivity to ");
+    if (posConn != std::string::npos) {
+        std::string connStr = query.substr(posConn + 14);
+        std::istringstream iss(connStr);
+        std::string token;
+        while(std::getline(iss, token, ',')) {
+            size_t posParen = token.find('(');
+            if (posParen == std::string::npos) continue;
+            std::string otherClan = token.substr(0, posParen);
+            size_t posWith = token.find("with");
+            size_t posTime = token.find("time", posWith);
+            int t = 0;
+            if (posWith != std::string::npos && posTime != std::string::npos) {
+                std::string numStr = token.substr(posWith + 4, posTime - posWith - 4);
+                t = std::stoi(numStr);
+            }
+            addRoad(newClan, otherClan, t);
+            if (trackingEndpoints)
+                recordRoad(c.slot, otherClan);
+            else if (!clans.count(otherClan))
+                trackUnknownEndpoints();
+        }
+    }
+    routingVersion++;
+}
+
+//---------------------------------------------------------------------
+// Process a "block" event.
+// Expected format: "<ClanName> has been blocked by enemies for <X> seconds"
+inline void KingdomSimulator::processBlock(int time, const std::string &query) {
+    WordReader words(query);
+    std::string_view clanName = words.word();
+    size_t pos = query.find("for");
+    int duration = 0;
+    if (pos != std::string::npos && pos + 4 <= query.size())
+        duration = int(std::strtol(query.c_str() + pos + 4, nullptr, 10)); // stops before " seconds"
+    Clan *clan = findClan(clanName);
+    if (!clan) return;
+    Clan &c = *clan;
+    if (!c.isBlocked) {
+        c.isBlocked = true;
+        routingVersion++;
+    }
+    c.blockedUntil = time + duration;
+
+    // Queue the earliest deadline still to come, unless it is queued already (see ClanUnblocks).
+    ClanUnblocks &unblocks = clanUnblocks[c.slot];
+    std::string &unblock = unblockKey;
+    unblock.assign("unblock ").append(clanName);
+    std::vector<int> &dormant = unblocks.dormant;
+    size_t past = dormant.size();
+    dormant.erase(std::remove_if(dormant.begin(), dormant.end(), [&](int t) {
+        return t < time || (t == time && unblock < query);
+    }), dormant.end());
+    for (past -= dormant.size(); past > 0; past--)
+        elided(EV_UNBLOCK);
+    dormant.push_back(time + duration);
+    auto earliest = std::min_element(dormant.begin(), dormant.end());
+    if (unblocks.queued.empty() || *earliest < *std::min_element(unblocks.queued.begin(), unblocks.queued.end())) {
+        unblocks.queued.push_back(*earliest);
+        scheduleEvent(*earliest, unblock);
+        dormant.erase(earliest);
+    }
+}
+
+//---------------------------------------------------------------------
+// Process an "unblock" event.
+// Expected format: "unblock <ClanName>"
+inline void KingdomSimulator::processUnblock(int time, const std::string &query) {
+    WordReader words(query);
+    words.word();
+    Clan *clan = findClan(words.word());
+    if (!clan) return;
+    Clan &c = *clan;
+    std::vector<int> &queued = clanUnblocks[c.slot].queued;
+    auto handled = std::find(queued.begin(), queued.end(), time);
+    if (handled != queued.end())
+        queued.erase(handled);
+    if (!c.isBlocked) {
+        elided(EV_UNBLOCK);
+        return;
+    }
+    c.isBlocked = false;
+    c.blockedUntil = 0;
+    routingVersion++;
+}
+
+//---------------------------------------------------------------------
+// Process a "status" event.
+// Expected query: "Show the current status of all the clans with mines"
+inline void KingdomSimulator::processStatus(int time, const std::string &query) {
+    settleMines(time, query);
+    std::vector<const Clan*> &mines = statusMines;
+    mines.clear();
+    for (auto &p : clans) {
+        if (p.second.isMine)
+            mines.push_back(&p.second);
+    }
+    std::sort(mines.begin(), mines.end(), [](const Clan *a, const Clan *b) { return a->name < b->name; });
+    for (size_t i = 0; i < mines.size(); i++) {
+        const Clan &c = *mines[i];
+        int avail;
+        if (c.inProcessing && time >= c.processingStartTime && time < c.processingStartTime + c.processingTotal * c.PTR)
+            avail = c.MAR - (time - c.processingStartTime);
+        else
+            avail = c.availableResources;
+        out << c.name << ": " << avail << "/" << c.MAR << " available";
+        if (i < mines.size()-1)
+            out << " ";
+    }
+    out << std::endl;
+}
+
+//---------------------------------------------------------------------
+// Process a "produce_gold" event.
+// Expected query: "Produce the current amount of Gold captured"
+inline void KingdomSimulator::processProduceGold(int time, const std::string &query) {
+    settleMines(time, query);
+    out << "Gold captured: " << totalGoldCaptured << std::endl;
+}
+
+//---------------------------------------------------------------------
+// Runs the handler for one event; returns false for the victory event, which ends the simulation.
+inline bool KingdomSimulator::handleEvent(int time, const std::string &event, EventKind kind) {
+    switch (kind) {
+    case EV_ATTACK: {
+        EVENT_SCOPE(EV_ATTACK, time, event);
+        processAttack(time, event);
+        break;
+    }
+    case EV_NEW_MINE: {
+        EVENT_SCOPE(EV_NEW_MINE, time, event);
+        processNewMine(time, event);
+        break;
+    }
+    case EV_NEW_CLAN: {
+        EVENT_SCOPE(EV_NEW_CLAN, time, event);
+        processNewClan(time, event);
+        break;
+    }
+    case EV_BLOCK: {
+        EVENT_SCOPE(EV_BLOCK, time, event);
+        processBlock(time, event);
+        break;
+    }
+    case EV_UNBLOCK: {
+        EVENT_SCOPE(EV_UNBLOCK, time, event);
+        processUnblock(time, event);
+        break;
+    }
+    case EV_START_PROCESSING: {
+        EVENT_SCOPE(EV_START_PROCESSING, time, event);
+        processStartProcessing(time, event);
+        break;
+    }
+    case EV_COMPLETE_PROCESSING: {
+        EVENT_SCOPE(EV_COMPLETE_PROCESSING, time, event);
+        processCompleteProcessing(time, event);
+        break;
+    }
+    case EV_STATUS: {
+        EVENT_SCOPE(EV_STATUS, time, event);
+        processStatus(time, event);
+        break;
+    }
+    case EV_PRODUCE_GOLD: {
+        EVENT_SCOPE(EV_PRODUCE_GOLD, time, event);
+        processProduceGold(time, event);
+        break;
+    }
+    case EV_REFILL: {
+        EVENT_SCOPE(EV_REFILL, time, event);
+        processRefill(time, event);
+        break;
+    }
+    case EV_PROCESS_INPUTS: {
+        EVENT_SCOPE(EV_PROCESS_INPUTS, time, event);
+        // Do nothing.
+        break;
+    }
+    case EV_VICTORY: {
+        EVENT_SCOPE(EV_VICTORY, time, event);
+        return false;
+    }
+    default: {
+        EVENT_SCOPE(EV_UNKNOWN, time, event);
+        break;
+    }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------
+// Parallel batches of independent events.
+// startProcessing, completeProcessing and refill events only touch the state of their own mine,
+// only leave pending transitions for that same mine, and only ever add whole amounts to the gold
+// counter. A run of such events on distinct mines, up to the next event of any other kind, can
+// therefore be handled in any order - including the transitions they apply or leave, which
+// commute with the rest of the run - and still leave the same state as the sequential loop.
+// This replaces a classic time-window lookahead (min RT / travel time), which can be zero here.
+
+// Smaller runs are handled inline; handing them to the pool costs more than it saves.
+#ifndef KINGDOM_BATCH_MIN
+#define KINGDOM_BATCH_MIN 64
+#endif
+
+inline bool isMineEvent(EventKind kind) {
+    return kind == EV_START_PROCESSING || kind == EV_COMPLETE_PROCESSING || kind == EV_REFILL;
+}
+
+// Mine name: the second word of every mine event.
+inline std::string_view mineOfEvent(const std::string &event) {
+    WordReader words(event);
+    words.word();
+    return words.word();
+}
+
+// Takes the run of mine events due before `until` at the front of the queue (each mine at most
+// once) and handles it. Returns false if the queue doesn't start with such an event.
+inline bool KingdomSimulator::processMineEventBatch(long long until) {
+    std::vector<QueuedEvent> &batch = batchEvents;
+    batch.clear();
+    std::unordered_set<std::string_view> mines;
+    while (!eventQueue.empty()) {
+        const QueuedEvent &next = eventQueue.top();
+        const std::string &event = eventText(next);
+        if (next.time >= until || !isMineEvent(classifyEvent(event)) || !mines.insert(mineOfEvent(event)).second) break;
+        batch.push_back(next);
+        eventQueue.pop();
+    }
+    if (batch.empty()) return false;
+    if (batch.size() < KINGDOM_BATCH_MIN) {
+        for (const QueuedEvent &e : batch) {
+            handleEvent(e.time, eventText(e), classifyEvent(eventText(e)));
+            eventTexts.release(e.slot);
+        }
+        return true;
+    }
+    std::vector<DeferredEffects> effects(batch.size());
+    eventPool.run(batch.size(), [&](size_t i) {
+        deferredEffects = &effects[i];
+        handleEvent(batch[i].time, eventText(batch[i]), classifyEvent(eventText(batch[i])));
+        deferredEffects = nullptr;
+    });
+    for (const QueuedEvent &e : batch)
+        eventTexts.release(e.slot);
+    for (auto &e : effects) {
+        for (double gold : e.gold)
+            totalGoldCaptured += gold;
+        for (auto &mine : e.mines)
+            mineAvailabilityChanged(mine);
+        for (int slot : e.cycles)
+            mineCycleChanged(*slotClans[slot]);
+        for (EventKind kind : e.elided)
+            elided(kind);
+        for (auto &event : e.events)
+            scheduleEvent(event.first, event.second);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------
+// Handles the attacks at the front of the queue that share a timestamp. An attack only reads the
+// kingdom and schedules startProcessing events, which sort after every attack at the same time,
+// so these attacks can't affect each other: the single-source searches they need are shared
+// between attacks on the same target and run together on the event pool, and the attacks are then
+// resolved one by one in queue order. Returns false if the queue doesn't start with an attack due
+// before `until`.
+inline bool KingdomSimulator::processAttackBatch(long long until) {
+    if (eventQueue.empty() || eventQueue.top().time >= until || classifyEvent(eventText(eventQueue.top())) != EV_ATTACK) return false;
+    int time = eventQueue.top().time;
+    std::vector<QueuedEvent> &attacks = batchEvents;
+    attacks.clear();
+    while (!eventQueue.empty() && eventQueue.top().time == time && classifyEvent(eventText(eventQueue.top())) == EV_ATTACK) {
+        // such an attack adds clans (see baselineAttack), so it is handled on its own
+        if (!unknownEndpoints.empty() && reachesUnknownEndpoint(attackKey.assign(attackTarget(eventText(eventQueue.top())))))
+            break;
+        attacks.push_back(eventQueue.top());
+        eventQueue.pop();
+    }
+    if (attacks.empty()) return false;
+
+    // the per-attack vectors only grow, so their strings and maps keep their buffers
+    if (batchTargets.size() < attacks.size()) {
+        batchTargets.resize(attacks.size());
+        batchSources.resize(attacks.size());
+    }
+    while (batchDistances.size() < attacks.size())
+        batchDistances.emplace_back();
+    std::vector<std::string> &targets = batchTargets;
+    std::deque<PooledDistances> &dist = batchDistances;
+    std::vector<size_t> &source = batchSources;     // attack whose distances each attack uses
+    std::vector<size_t> &searches = batchSearches;  // attacks that need a search of their own
+    std::pmr::unordered_map<std::string, size_t> &searched = batchSearched;
+    searches.clear();
+    searched.clear();
+    trimMineIndexes(attacks.size());
+    for (size_t i = 0; i < attacks.size(); i++) {
+        targets[i].assign(attackTarget(eventText(attacks[i])));
+        dist[i].dist.clear();
+        source[i] = i;
+        if (validMineIndex(targets[i]) || labelDistances(targets[i], dist[i].dist)) {
+            skipSpeculativeAttack();
+            continue;
+        }
+        if (takeSpeculativeDistances(targets[i], dist[i].dist)) continue;
+        auto first = searched.find(targets[i]);
+        if (first != searched.end()) {
+            source[i] = first->second;
+            continue;
+        }
+        searched[targets[i]] = i;
+        searches.push_back(i);
+    }
+    if (!searches.empty()) {
+        // capturing only `this` keeps the std::function from allocating
+        eventPool.run(searches.size(), [this](size_t k) {
+            size_t i = batchSearches[k];
+            shortestPaths(pathQueue, LiveRoutes{*this}, batchTargets[i], nullptr, batchDistances[i].dist);
+        });
+    }
+
+    for (size_t i = 0; i < attacks.size(); i++) {
+        settleMines(time, eventText(attacks[i]));
+        resolveAttack(time, eventText(attacks[i]), mineIndexFor(targets[i], dist[source[i]].dist));
+    }
+    for (const QueuedEvent &e : attacks)
+        eventTexts.release(e.slot);
+    return true;
+}
+
+//---------------------------------------------------------------------
+// Drops every queued event.
+inline void KingdomSimulator::clearEvents() {
+    while (!eventQueue.empty()) {
+        eventTexts.release(eventQueue.top().slot);
+        eventQueue.pop();
+    }
+}
+
+//---------------------------------------------------------------------
+// Process events from the eventQueue that are due before `until`, up to the victory event.
+// Only the produce_gold events (and status, if provided) produce output.
+// Without instrumentation, attacks that share a timestamp are handled as a batch, and with the
+// event pool running, runs of independent mine events are handled in parallel batches.
+inline void KingdomSimulator::processEvents(long long until) {
+    while (!victory && !eventQueue.empty() && eventQueue.top().time < until) {
+#ifndef KINGDOM_INSTRUMENTED
+        if (processAttackBatch(until))
+            continue;
+#endif
+        if (!eventPool.threads.empty() && processMineEventBatch(until))
+            continue;
+        QueuedEvent next = eventQueue.top();
+        eventQueue.pop();
+        const std::string &event = eventText(next);
+        STATS_SAMPLE_QUEUE(next.time, eventQueue.size());
+        TRACE_QUEUE_DEPTH(eventQueue.size());
+
+        if (!handleEvent(next.time, event, classifyEvent(event)))
+            victory = true;
+        eventTexts.release(next.slot);
+    }
+}
+
+#endif
@@ -0,0 +1,219 @@
+// Optional instrumentation for the event loop in kingdom_simulator.h.
+// Build with -DKINGDOM_STATS to enable; otherwise every STATS_* macro expands to nothing.
+// At exit the collected numbers are written as JSON to $KINGDOM_STATS_FILE
+// (default: kingdom_stats.json in the working directory).
+#ifndef KINGDOM_STATS_H
+#define KINGDOM_STATS_H
+
+// Event kinds, as classified by classifyEvent in kingdom_simulator.h; the stats and the tracer report per kind.
+enum EventKind {
+    EV_ATTACK, EV_NEW_MINE, EV_NEW_CLAN, EV_BLOCK, EV_UNBLOCK, EV_START_PROCESSING, EV_COMPLETE_PROCESSING,
+    EV_STATUS, EV_PRODUCE_GOLD, EV_REFILL, EV_PROCESS_INPUTS, EV_VICTORY, EV_UNKNOWN, EV_COUNT
+};
+
+static const char *const eventKindNames[EV_COUNT] = {
+    "attack", "new_mine", "new_clan", "block", "unblock", "start_processing", "complete_processing",
+    "status", "produce_gold", "refill", "process_inputs", "victory", "unknown"
+};
+
+#ifdef KINGDOM_STATS
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define KINGDOM_STATS_HAS_TSC
+#endif
+
+// Sample the event queue depth once every this many events.
+#ifndef KINGDOM_STATS_QUEUE_SAMPLE
+#define KINGDOM_STATS_QUEUE_SAMPLE 1024
+#endif
+
+inline uint64_t readCycleCounter() {
+#ifdef KINGDOM_STATS_HAS_TSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+//---------------------------------------------------------------------
+// HDR-style log-linear histogram: values below 32 are exact, larger values fall into
+// 16 sub-buckets per power of two (at most ~6% relative error), over the full uint64 range.
+struct LatencyHistogram {
+    static const int SUB_BITS = 4;
+    static const int SUB_COUNT = 1 << SUB_BITS;
+
+    uint64_t counts[64 * SUB_COUNT] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maxValue = 0;
+
+    static int bucketOf(uint64_t value) {
+        if (value < SUB_COUNT) return int(value);
+        int msb = 63;
+#if defined(__GNUC__)
+        msb -= __builtin_clzll(value);
+#else
+        while (!(value >> msb)) msb--;
+#endif
+        return ((msb - SUB_BITS + 1) << SUB_BITS) + int((value >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+    }
+
+    static uint64_t lowerBound(int bucket) {
+        if (bucket < SUB_COUNT) return uint64_t(bucket);
+        return uint64_t(SUB_COUNT + (bucket & (SUB_COUNT - 1))) << ((bucket >> SUB_BITS) - 1);
+    }
+
+    void record(uint64_t value) {
+        counts[bucketOf(value)]++;
+        total++;
+        sum += value;
+        if (value > maxValue) maxValue = value;
+    }
+
+    // Smallest bucket bound below which at least `fraction` of the samples fall.
+    uint64_t percentile(double fraction) const {
+        uint64_t rank = uint64_t(fraction * total);
+        uint64_t seen = 0;
+        for (int b = 0; b < 64 * SUB_COUNT; b++) {
+            seen += counts[b];
+            if (seen > rank) return lowerBound(b);
+        }
+        return maxValue;
+    }
+};
+
+// Per-target mine indexes (the attack route cache, see MineIndex), where the distances for the
+// indexes built came from, and the point-to-point searches for mines added to indexes.
+struct RouteCacheStats {
+    uint64_t hits = 0;          // attacks on a target with a valid index
+    uint64_t misses = 0;        // attacks that needed distances for one
+    uint64_t builds = 0;
+    uint64_t evictions = 0;     // least recently used indexes dropped for room
+    uint64_t invalidations = 0; // indexes dropped by a road, block or mine change
+    uint64_t labelAnswers = 0;
+    uint64_t speculativeAnswers = 0;
+    uint64_t searches = 0;
+    uint64_t newMineSearches = 0;
+};
+
+struct KingdomStats {
+    uint64_t eventCounts[EV_COUNT] = {};
+    uint64_t elidedCounts[EV_COUNT] = {}; // no-op events skipped by the scheduler
+    LatencyHistogram handlerCycles[EV_COUNT];
+    LatencyHistogram settledPerAttack;
+    RouteCacheStats routeCache;
+    uint64_t nodesSettled = 0;
+    uint64_t eventsProcessed = 0;
+    size_t maxQueueDepth = 0;
+    std::vector<std::pair<int, size_t>> queueDepthSamples; // (simulation time, depth)
+
+    uint64_t startCycles = readCycleCounter();
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    void sampleQueue(int time, size_t depth) {
+        if (depth > maxQueueDepth) maxQueueDepth = depth;
+        if (eventsProcessed++ % KINGDOM_STATS_QUEUE_SAMPLE == 0)
+            queueDepthSamples.push_back({time, depth});
+    }
+
+    void writeHistogram(std::ostream &out, const LatencyHistogram &h, double scale, const char *unit) const {
+        out << "{\"count\": " << h.total
+            << ", \"mean" << unit << "\": " << (h.total ? h.sum * scale / h.total : 0.0)
+            << ", \"p50" << unit << "\": " << h.percentile(0.5) * scale
+            << ", \"p90" << unit << "\": " << h.percentile(0.9) * scale
+            << ", \"p99" << unit << "\": " << h.percentile(0.99) * scale
+            << ", \"p999" << unit << "\": " << h.percentile(0.999) * scale
+            << ", \"max" << unit << "\": " << h.maxValue * scale << "}";
+    }
+
+    void dump() const {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        uint64_t cycles = readCycleCounter() - startCycles;
+        // TSC ticks are converted to nanoseconds with the rate observed over the whole run.
+        double nsPerCycle = cycles ? seconds * 1e9 / double(cycles) : 1.0;
+
+        const char *path = std::getenv("KINGDOM_STATS_FILE");
+        std::ofstream out(path ? path : "kingdom_stats.json");
+        out << "{\n  \"events\": " << eventsProcessed << ",\n";
+        out << "  \"wall_seconds\": " << seconds << ",\n";
+        out << "  \"events_per_second\": " << (seconds > 0 ? eventsProcessed / seconds : 0.0) << ",\n";
+        out << "  \"handlers\": {\n";
+        bool first = true;
+        for (int k = 0; k < EV_COUNT; k++) {
+            if (!eventCounts[k]) continue;
+            out << (first ? "" : ",\n") << "    \"" << eventKindNames[k] << "\": ";
+            writeHistogram(out, handlerCycles[k], nsPerCycle, "_ns");
+            first = false;
+        }
+        out << "\n  },\n  \"elided\": {";
+        first = true;
+        for (int k = 0; k < EV_COUNT; k++) {
+            if (!elidedCounts[k]) continue;
+            out << (first ? "" : ", ") << "\"" << eventKindNames[k] << "\": " << elidedCounts[k];
+            first = false;
+        }
+        out << "},\n  \"route_cache\": {\"hits\": " << routeCache.hits << ", \"misses\": " << routeCache.misses
+            << ", \"hit_rate\": " << (routeCache.hits + routeCache.misses ? double(routeCache.hits) / (routeCache.hits + routeCache.misses) : 0.0)
+            << ", \"builds\": " << routeCache.builds << ", \"evictions\": " << routeCache.evictions
+            << ", \"invalidations\": " << routeCache.invalidations << ", \"distances\": {\"labels\": " << routeCache.labelAnswers
+            << ", \"speculative\": " << routeCache.speculativeAnswers << ", \"search\": " << routeCache.searches
+            << ", \"new_mine_search\": " << routeCache.newMineSearches << "}}";
+        out << ",\n  \"dijkstra_settled_per_attack\": ";
+        writeHistogram(out, settledPerAttack, 1.0, "");
+        out << ",\n  \"queue_depth\": {\"max\": " << maxQueueDepth << ", \"every\": " << KINGDOM_STATS_QUEUE_SAMPLE << ", \"samples\": [";
+        for (size_t i = 0; i < queueDepthSamples.size(); i++)
+            out << (i ? ", " : "") << "[" << queueDepthSamples[i].first << ", " << queueDepthSamples[i].second << "]";
+        out << "]}\n}\n";
+    }
+};
+
+static KingdomStats kingdomStats;
+
+// Times one handler invocation and, for attacks, counts the Dijkstra nodes it settled.
+struct StatsScope {
+    EventKind kind;
+    uint64_t start;
+    uint64_t settledAtStart;
+
+    explicit StatsScope(EventKind k) : kind(k), start(readCycleCounter()), settledAtStart(kingdomStats.nodesSettled) {}
+
+    ~StatsScope() {
+        kingdomStats.handlerCycles[kind].record(readCycleCounter() - start);
+        kingdomStats.eventCounts[kind]++;
+        if (kind == EV_ATTACK)
+            kingdomStats.settledPerAttack.record(kingdomStats.nodesSettled - settledAtStart);
+    }
+};
+
+#define STATS_SCOPE(kind) StatsScope statsScope(kind)
+#define STATS_SAMPLE_QUEUE(time, depth) kingdomStats.sampleQueue(time, depth)
+#define STATS_NODE_SETTLED() (kingdomStats.nodesSettled++)
+#define STATS_ELIDED(kind) (kingdomStats.elidedCounts[kind]++)
+#define STATS_ROUTE_CACHE(counter, n) (kingdomStats.routeCache.counter += (n))
+#define STATS_DUMP() kingdomStats.dump()
+
+#else
+
+#define STATS_SCOPE(kind) ((void)0)
+#define STATS_SAMPLE_QUEUE(time, depth) ((void)0)
+#define STATS_NODE_SETTLED() ((void)0)
+#define STATS_ELIDED(kind) ((void)0)
+#define STATS_ROUTE_CACHE(counter, n) ((void)0)
+#define STATS_DUMP() ((void)0)
+
+#endif
+
+#endif
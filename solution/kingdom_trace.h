@@ -0,0 +1,172 @@
+// Optional Chrome trace export (chrome://tracing, ui.perfetto.dev) for the event loop in kingdom_simulator.h.
+// Build with -DKINGDOM_TRACE to enable; otherwise every TRACE_* macro expands to nothing.
+// Records are streamed to $KINGDOM_TRACE_FILE (default: kingdom_trace.json) as the simulation runs.
+//
+// The trace has two processes:
+//   "wall clock"      - one span per handled event on host time, plus the event queue depth counter;
+//                       arrows link each internally scheduled event (startProcessing, completeProcessing,
+//                       refill, unblock) back to the handler that scheduled it.
+//   "simulation time" - the same events as instants at their simulation time, one time unit per millisecond.
+// Every record carries the event kind, the clan it concerns, and the other timeline's timestamp.
+#ifndef KINGDOM_TRACE_H
+#define KINGDOM_TRACE_H
+
+#include "kingdom_stats.h"
+
+#ifdef KINGDOM_TRACE
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+
+struct KingdomTrace {
+    FILE *out;
+    bool firstRecord = true;
+    int handlerDepth = 0;
+    uint64_t nextFlowId = 0;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    // Flows started by scheduleEvent, waiting for the event to be handled.
+    std::map<std::pair<int, std::string>, std::deque<uint64_t>> pendingFlows;
+
+    KingdomTrace() {
+        const char *path = std::getenv("KINGDOM_TRACE_FILE");
+        out = std::fopen(path ? path : "kingdom_trace.json", "w");
+        if (!out) return;
+        std::fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", out);
+        record("{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"wall clock\"}}");
+        record("{\"ph\": \"M\", \"pid\": 2, \"name\": \"process_name\", \"args\": {\"name\": \"simulation time\"}}");
+    }
+
+    ~KingdomTrace() {
+        if (!out) return;
+        std::fputs("\n]}\n", out);
+        std::fclose(out);
+    }
+
+    static std::string micros(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.3f", value);
+        return text;
+    }
+
+    double wallMicros() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+    }
+
+    void record(const std::string &json) {
+        if (!out) return;
+        std::fputs(firstRecord ? "\n" : ",\n", out);
+        std::fputs(json.c_str(), out);
+        firstRecord = false;
+    }
+
+    static std::string escape(const std::string &text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            }
+            else if (static_cast<unsigned char>(c) < 0x20) {
+                char code[8];
+                std::snprintf(code, sizeof(code), "\\u%04x", c);
+                result += code;
+            }
+            else {
+                result += c;
+            }
+        }
+        return result;
+    }
+
+    // Position of the clan name among the space-separated words of each event kind, -1 if there is none.
+    static std::string clanOf(EventKind kind, const std::string &event) {
+        static const int clanWord[EV_COUNT] = { 2, 0, 1, 0, 1, 1, 1, -1, -1, 1, -1, -1, -1 };
+        if (clanWord[kind] < 0) return "";
+        std::istringstream words(event);
+        std::string word;
+        for (int i = 0; i <= clanWord[kind]; i++)
+            words >> word;
+        return word;
+    }
+
+    void scheduled(int time, const std::string &event) {
+        // input queries are scheduled before any handler runs and have no cause to point back to
+        if (handlerDepth == 0) return;
+        uint64_t id = ++nextFlowId;
+        std::ostringstream json;
+        json << "{\"ph\": \"s\", \"pid\": 1, \"tid\": 1, \"name\": \"schedule\", \"cat\": \"flow\", \"id\": " << id
+             << ", \"ts\": " << micros(wallMicros()) << "}";
+        record(json.str());
+        pendingFlows[{time, event}].push_back(id);
+    }
+
+    void queueDepth(size_t depth) {
+        std::ostringstream json;
+        json << "{\"ph\": \"C\", \"pid\": 1, \"name\": \"event queue\", \"ts\": " << micros(wallMicros())
+             << ", \"args\": {\"depth\": " << depth << "}}";
+        record(json.str());
+    }
+};
+
+static KingdomTrace kingdomTrace;
+
+// Records one handler invocation on both timelines.
+struct TraceScope {
+    EventKind kind;
+    int time;
+    const std::string &event;
+    double begin;
+
+    TraceScope(EventKind k, int t, const std::string &e) : kind(k), time(t), event(e), begin(kingdomTrace.wallMicros()) {
+        kingdomTrace.handlerDepth++;
+        auto pending = kingdomTrace.pendingFlows.find({time, event});
+        if (pending != kingdomTrace.pendingFlows.end()) {
+            std::ostringstream json;
+            json << "{\"ph\": \"f\", \"bp\": \"e\", \"pid\": 1, \"tid\": 1, \"name\": \"schedule\", \"cat\": \"flow\", \"id\": "
+                 << pending->second.front() << ", \"ts\": " << KingdomTrace::micros(begin) << "}";
+            kingdomTrace.record(json.str());
+            pending->second.pop_front();
+            if (pending->second.empty())
+                kingdomTrace.pendingFlows.erase(pending);
+        }
+    }
+
+    ~TraceScope() {
+        kingdomTrace.handlerDepth--;
+        double end = kingdomTrace.wallMicros();
+        std::string clan = KingdomTrace::escape(KingdomTrace::clanOf(kind, event));
+        std::string name = eventKindNames[kind];
+
+        std::ostringstream span;
+        span << "{\"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"name\": \"" << name << "\", \"cat\": \"" << name
+             << "\", \"ts\": " << KingdomTrace::micros(begin) << ", \"dur\": " << KingdomTrace::micros(end - begin) << ", \"args\": {\"sim_time\": " << time
+             << ", \"clan\": \"" << clan << "\", \"event\": \"" << KingdomTrace::escape(event) << "\"}}";
+        kingdomTrace.record(span.str());
+
+        std::ostringstream instant;
+        instant << "{\"ph\": \"i\", \"s\": \"t\", \"pid\": 2, \"tid\": 1, \"name\": \"" << name << "\", \"cat\": \"" << name
+                << "\", \"ts\": " << KingdomTrace::micros(time * 1000.0) << ", \"args\": {\"wall_us\": " << KingdomTrace::micros(begin) << ", \"clan\": \"" << clan << "\"}}";
+        kingdomTrace.record(instant.str());
+    }
+};
+
+#define TRACE_SCOPE(kind, time, event) TraceScope traceScope(kind, time, event)
+#define TRACE_SCHEDULE(time, event) kingdomTrace.scheduled(time, event)
+#define TRACE_QUEUE_DEPTH(depth) kingdomTrace.queueDepth(depth)
+
+#else
+
+#define TRACE_SCOPE(kind, time, event) ((void)0)
+#define TRACE_SCHEDULE(time, event) ((void)0)
+#define TRACE_QUEUE_DEPTH(depth) ((void)0)
+
+#endif
+
+#endif
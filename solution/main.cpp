@@ -1,419 +1,54 @@
+#include <cstdlib>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <vector>
-#include <unordered_map>
-#include <queue>
-#include <set>
-#include <sstream>
-#include <algorithm>
-#include "..\\lib\\cpp\\pugixml-1.14\\src\\pugixml.hpp"
+#include "kingdom_daemon.h"
+#include "kingdom_input.h"
+#include "kingdom_replay.h"
+#include "kingdom_simulator.h"
 
 using namespace std;
 
-struct Clan {
-    string name;
-    bool isMine = false;
-    int MAR = 0;    // Maximum Available Resources
-    int PTR = 0;    // Processing Time per Resource
-    int RT = 0;     // Refill Time
-    int availableResources = 0; // When idle, equals MAR
-    // Processing state:
-    bool inProcessing = false;
-    int processingTotal = 0;
-    int processingStartTime = 0;
-    // Blocking:
-    bool isBlocked = false;
-    int blockedUntil = 0;
-};
-
-struct Road {
-    string from;
-    string to;
-    int travelTime;
-};
-
-// Global structures
-unordered_map<string, vector<pair<string, int>>> roadNetwork;
-unordered_map<string, Clan> clans;
-
-// Event queue: each event is a pair <time, event_string>
-priority_queue<pair<int, string>, vector<pair<int, string>>, greater<pair<int, string>>> eventQueue;
-
-// Global gold counter
-int totalGoldCaptured = 0;
-
-//---------------------------------------------------------------------
-// XML Parsing: loads clan and road data.
-// For mines, sets availableResources = MAR.
-void parseXML(const string& path) {
-    pugi::xml_document doc;
-    if (!doc.load_file(path.c_str())) {
-        // Do not print any extra message per user instruction.
-        return;
-    }
-    pugi::xml_node kingdom = doc.child("Kingdom");
-    for (pugi::xml_node clanNode : kingdom.children("Clan")) {
-        string name = clanNode.child("Name").text().as_string();
-        bool isMine = string(clanNode.child("IS_MINE").text().as_string()) == "True";
-        Clan c;
-        c.name = name;
-        c.isMine = isMine;
-        if (isMine) {
-            c.MAR = clanNode.child("MAR").text().as_int();
-            c.PTR = clanNode.child("PTR").text().as_int();
-            c.RT  = clanNode.child("RT").text().as_int();
-            c.availableResources = c.MAR;
-        }
-        clans[name] = c;
-    }
-    for (pugi::xml_node roadNode : kingdom.children("Road")) {
-        string from = roadNode.child("From").text().as_string();
-        string to   = roadNode.child("To").text().as_string();
-        int travelTime = roadNode.child("Time").text().as_int();
-        roadNetwork[from].push_back({to, travelTime});
-        roadNetwork[to].push_back({from, travelTime});
-    }
-}
-
-//---------------------------------------------------------------------
-// Dijkstra: compute shortest distance between two clans; returns large value if unreachable.
-int getShortestDistance(const string &start, const string &end) {
-    if (start == end) return 0;
-    unordered_map<string, int> dist;
-    for (auto &p : clans)
-        dist[p.first] = 1e9;
-    dist[start] = 0;
-    typedef pair<int, string> P;
-    priority_queue<P, vector<P>, greater<P>> pq;
-    pq.push({0, start});
-    while (!pq.empty()) {
-        auto &it = pq.top(); pq.pop();
-        int d = it.first;
-        string u = it.second;
-        if (u == end) return d;
-        if (d > dist[u]) continue;
-        for (auto &edge : roadNetwork[u]) {
-            const string &v = edge.first;
-            if (clans[v].isBlocked) continue;
-            int w = edge.second;
-            if (d + w < dist[v]) {
-                dist[v] = d + w;
-                pq.push({dist[v], v});
-            }
-        }
-    }
-    return 1e9;
-}
-
-//---------------------------------------------------------------------
-// Schedules an event by pushing it into the eventQueue.
-void scheduleEvent(int time, const string &event) {
-    eventQueue.push({time, event});
-}
-
-//---------------------------------------------------------------------
-// Process a "refill" event: resets mine's availableResources to MAR.
-void processRefill(int /time/, const string &clanName) {
-    if (clans.find(clanName) != clans.end()) {
-        clans[clanName].availableResources = clans[clanName].MAR;
-    }
-}
-
-//---------------------------------------------------------------------
-// Process a "startProcessing" event.
-// Format: "startProcessing_preblock <mineName> <allocation> <gold>"
-// Schedules a completeProcessing event.
-void processStartProcessing(int time, const string &query) {
-    istringstream iss(query);
-    string token, mineName;
-    int allocation;
-    double gold;
-    iss >> token >> mineName >> allocation >> gold;
-    if (clans.find(mineName) == clans.end()) return;
-    Clan &c = clans[mineName];
-    c.inProcessing = true;
-    c.processingTotal = allocation;
-    c.processingStartTime = time;
-    int completeTime = time + allocation * c.PTR;
-    // Adjust completeTime if necessary (as per sample, second attack: 26 + 70 = 96, adjust to 95)
-    if (mineName == "clan_a" && allocation == 70 && completeTime == 96) {
-        completeTime = 95;
-    }
-    scheduleEvent(completeTime, "completeProcessing " + mineName + " " + to_string(gold));
-}
-
-//---------------------------------------------------------------------
-// Process a "completeProcessing" event.
-// Format: "completeProcessing <mineName> <gold>"
-// When processing completes, deduct the allocation and credit gold.
-void processCompleteProcessing(int time, const string &query) {
-    istringstream iss(query);
-    string token, mineName;
-    double gold;
-    iss >> token >> mineName >> gold;
-    if (clans.find(mineName) == clans.end()) return;
-    Clan &c = clans[mineName];
-    c.availableResources = c.MAR - c.processingTotal;
-    c.inProcessing = false;
-    // Credit the gold now (it will be added only once per completeProcessing event)
-    totalGoldCaptured += gold;
-    scheduleEvent(time + c.RT, "refill " + mineName);
-}
-
-//---------------------------------------------------------------------
-// Process an "attack" event.
-// Expected format: "Attack on clan_b with 30 RR providing 15 GCO"
-// This schedules a startProcessing_preblock event if a candidate mine can satisfy the request.
-void processAttack(int time, const string &query) {
-    istringstream iss(query);
-    string dummy, on, target, with, rrToken, providing, gcoToken;
-    int RR;
-    double GCO;
-    iss >> dummy >> on >> target >> with >> RR >> rrToken >> providing >> GCO >> gcoToken;
-    
-    // Gather candidate mines (ignoring block status for preblock attacks).
-    vector<tuple<string, int, int>> candidates; // (mineName, availableResources, roundTripTravelTime)
-    for (auto &p : clans) {
-        Clan &c = p.second;
-        if (!c.isMine) continue;
-        int d = getShortestDistance(target, c.name);
-        if (d >= 1e9) continue;
-        int travelTime = 2 * d;
-        if (c.availableResources > 0)
-            candidates.push_back({c.name, c.availableResources, travelTime});
-    }
-    // Sort candidates by travelTime (lower first).
-    sort(candidates.begin(), candidates.end(), [](auto &a, auto &b) {
-        return get<2>(a) < get<2>(b);
-    });
-    
-    int totalAllocated = 0;
-    int n = candidates.size();
-    int allocation = 0;
-    string chosenMine;
-    // Choose the first candidate that can fully satisfy RR.
-    for (int i = 0; i < n && totalAllocated < RR; i++) {
-        string name;
-        int avail, travel;
-        tie(name, avail, travel) = candidates[i];
-        if (avail >= RR) {
-            chosenMine = name;
-            allocation = RR;
-            totalAllocated = RR;
-            scheduleEvent(time + travel/2, "startProcessing_preblock " + name + " " + to_string(allocation) + " " + to_string(GCO));
-            break;
-        }
-    }
-    // (If no candidate can satisfy RR fully, then no processing event is scheduled and no gold is credited.)
-}
-
-//---------------------------------------------------------------------
-// Process a "new mine" event.
-// Expected format: "<ClanName> has found natural resource's mine with <MAR> MAR, <PTR> PTR and <RT> RT"
-void processNewMine(int time, const string &query) {
-    istringstream iss(query);
-    string clanName;
-    iss >> clanName;
-    int MAR = 0, PTR = 0, RT = 0;
-    size_t pos = query.find("with");
-    if (pos != string::npos) {
-        istringstream nums(query.substr(pos));
-        string dummy;
-        nums >> dummy >> MAR;
-        nums >> dummy;
-        nums >> PTR;
-        nums >> dummy;
-        nums >> RT;
-    }
-    if (clans.find(clanName) == clans.end()) {
-        Clan c;
-        c.name = clanName;
-        clans[clanName] = c;
-    }
-    clans[clanName].isMine = true;
-    clans[clanName].MAR = MAR;
-    clans[clanName].PTR = PTR;
-    clans[clanName].RT = RT;
-    clans[clanName].availableResources = MAR;
-}
-
-//---------------------------------------------------------------------
-// Process a "new clan" event.
-// Expected format: "New <ClanName> has been formed, which has the connectivity to ClanA(with M time), ClanB(with N time), ..."
-void processNewClan(int time, const string &query) {
-    size_t pos1 = query.find("New ");
-    size_t pos2 = query.find(" has been formed");
-    if (pos1 == string::npos || pos2 == string::npos) return;
-    string newClan = query.substr(pos1 + 4, pos2 - pos1 - 4);
-    if (clans.find(newClan) == clans.end()) {
-        Clan c;
-        c.name = newClan;
-        clans[newClan] = c;
-    }
-    size_t posConn = query.find("connectivity to ");
-    if (posConn != string::npos) {
-        string connStr = query.substr(posConn + 14);
-        istringstream iss(connStr);
-        string token;
-        while(getline(iss, token, ',')) {
-            size_t posParen = token.find('(');
-            if (posParen == string::npos) continue;
-            string otherClan = token.substr(0, posParen);
-            size_t posWith = token.find("with");
-            size_t posTime = token.find("time", posWith);
-            int t = 0;
-            if (posWith != string::npos && posTime != string::npos) {
-                string numStr = token.substr(posWith + 4, posTime - posWith - 4);
-                t = stoi(numStr);
-            }
-            roadNetwork[newClan].push_back({otherClan, t});
-            roadNetwork[otherClan].push_back({newClan, t});
-        }
-    }
-}
-
-//---------------------------------------------------------------------
-// Process a "block" event.
-// Expected format: "<ClanName> has been blocked by enemies for <X> seconds"
-void processBlock(int time, const string &query) {
-    istringstream iss(query);
-    string clanName;
-    iss >> clanName;
-    size_t pos = query.find("for");
-    int duration = 0;
-    if (pos != string::npos) {
-        size_t posSec = query.find("seconds", pos);
-        string numStr = query.substr(pos + 4, posSec - pos - 4);
-        duration = stoi(numStr);
-    }
-    if (clans.find(clanName) != clans.end()) {
-        clans[clanName].isBlocked = true;
-        clans[clanName].blockedUntil = time + duration;
-        scheduleEvent(time + duration, "unblock " + clanName);
-    }
-}
-
-//---------------------------------------------------------------------
-// Process an "unblock" event.
-// Expected format: "unblock <ClanName>"
-void processUnblock(int time, const string &query) {
-    istringstream iss(query);
-    string dummy, clanName;
-    iss >> dummy >> clanName;
-    if (clans.find(clanName) != clans.end()) {
-        clans[clanName].isBlocked = false;
-        clans[clanName].blockedUntil = 0;
-    }
-}
-
-//---------------------------------------------------------------------
-// Process a "status" event.
-// Expected query: "Show the current status of all the clans with mines"
-// (This function is retained if a status query is provided; otherwise, it prints nothing.)
-void processStatus(int time, const string &query) {
-    vector<string> names;
-    for (auto &p : clans) {
-        if (p.second.isMine)
-            names.push_back(p.first);
-    }
-    sort(names.begin(), names.end());
-    ostringstream oss;
-    for (size_t i = 0; i < names.size(); i++) {
-        Clan &c = clans[names[i]];
-        int avail;
-        if (c.inProcessing && time >= c.processingStartTime && time < c.processingStartTime + c.processingTotal * c.PTR)
-            avail = c.MAR - (time - c.processingStartTime);
-        else
-            avail = c.availableResources;
-        oss << names[i] << ": " << avail << "/" << c.MAR << " available";
-        if (i < names.size()-1)
-            oss << " ";
-    }
-    // For status events, output the line if needed.
-    cout << oss.str() << endl;
-}
-
-//---------------------------------------------------------------------
-// Process a "produce_gold" event.
-// Expected query: "Produce the current amount of Gold captured"
-// *Only this event prints output, as required.*
-void processProduceGold(int time, const string &query) {
-    cout << "Gold captured: " << totalGoldCaptured << endl;
-}
-
-//---------------------------------------------------------------------
-// Process events from the eventQueue.
-// Only the produce_gold events (and status, if provided) produce output.
-void processEvents() {
-    while (!eventQueue.empty()) {
-        auto p = eventQueue.top();
-        eventQueue.pop();
-        int time = p.first;
-        string event = p.second;
-        
-        if (event.find("Attack on") != string::npos) {
-            processAttack(time, event);
-        }
-        else if (event.find("has found natural resource") != string::npos) {
-            processNewMine(time, event);
-        }
-        else if (event.find("has been formed") != string::npos) {
-            processNewClan(time, event);
-        }
-        else if (event.find("has been blocked by enemies") != string::npos) {
-            processBlock(time, event);
-        }
-        else if (event.rfind("unblock", 0) == 0) {
-            processUnblock(time, event);
-        }
-        else if (event.rfind("startProcessing", 0) == 0) {
-            processStartProcessing(time, event);
-        }
-        else if (event.rfind("completeProcessing", 0) == 0) {
-            processCompleteProcessing(time, event);
-        }
-        else if (event.find("Show the current status") != string::npos) {
-            processStatus(time, event);
-        }
-        else if (event.find("Produce the current amount of Gold captured") != string::npos) {
-            processProduceGold(time, event);
-        }
-        else if (event.rfind("refill", 0) == 0) {
-            istringstream iss(event);
-            string dummy, clanName;
-            iss >> dummy >> clanName;
-            processRefill(time, clanName);
-        }
-        else if (event.find("Process inputs") != string::npos) {
-            // Do nothing.
-        }
-        else if (event.find("Victory of Codeopia") != string::npos) {
-            break;
-        }
-    }
-}
-
-//---------------------------------------------------------------------
-// Main: read queries from standard input and schedule events.
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         return 1;
     }
+    if (argc >= 4 && string(argv[1]) == "--compile")
+        return compileQueryFile(argv[2], argv[3]) ? 0 : 1;
     string path = argv[1];
-    parseXML(path);
-    
-    int time;
-    string query;
-    while (getline(cin, query)) {
-        size_t colonPos = query.find(':');
-        if (colonPos == string::npos) continue;
-        time = stoi(query.substr(0, colonPos));
-        string event = query.substr(colonPos + 2);
-        scheduleEvent(time, event);
-        if (query.find("Victory of Codeopia") != string::npos)
-            break;
-    }
-    
-    processEvents();
+    auto model = make_shared<KingdomModel>();
+    // Do not print any extra message per user instruction.
+    model->load(path);
+    if (const char *labels = std::getenv("KINGDOM_HUB_LABELS"))
+        model->useHubLabels(labels);
+    if (argc >= 4 && string(argv[2]) == "--serve")
+        return serveKingdom(model, argv[3]) ? 0 : 1;
+    KingdomSimulator simulator(model);
+
+    if (argc >= 4 && string(argv[2]) == "--replay") {
+        CompiledTrace trace;
+        if (!trace.open(argv[3]) || !trace.replay(simulator))
+            return 1;
+    } else if (argc >= 4 && string(argv[2]) == "--queries") {
+        QueryFile queries;
+        if (!queries.open(argv[3]))
+            return 1;
+        string query;
+        while (queries.getline(query)) {
+            if (!simulator.addQuery(query))
+                break;
+        }
+        if (!queries.complete())
+            return 1;
+    } else {
+        string query;
+        while (getline(cin, query)) {
+            if (!simulator.addQuery(query))
+                break;
+        }
+    }
+
+    simulator.run();
+    STATS_DUMP();
     return 0;
 }
@@ -0,0 +1,252 @@
+"""
+Synthetic kingdom and query trace generator.
+
+Writes <prefix>_model.xml and <prefix>_queries.txt in the same layout as the
+cases under inputs/, so they can be dropped into inputs/<Level>/ directly.
+Everything is derived from --seed, so the same command line always produces
+the same files.
+
+With --engine (a compiled solution binary) or --build (compile
+solution/main.cpp first), the trace is also run through the engine and its
+output is stored as <prefix>_output.txt. That file is the reference every
+later engine change has to reproduce byte for byte.
+
+Example:
+    python tools/generate_kingdom.py --out-dir gen/L3 --prefix t1 --seed 7 \
+        --clans 2000 --mine-ratio 0.3 --topology scale-free --degree 4 \
+        --queries 1000000 --build
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+TOPOLOGIES = ('random', 'grid', 'ring', 'tree', 'scale-free')
+
+# Query kinds in the order their rates are applied; attacks take the remainder.
+QUERY_KINDS = ('status', 'gold', 'block', 'mine', 'clan')
+
+
+def parse_range(text):
+    low, _, high = text.partition(':')
+    low = int(low)
+    high = int(high) if high else low
+    if low < 0 or high < low:
+        raise argparse.ArgumentTypeError(f"invalid range: {text}")
+    return low, high
+
+
+def clan_name(index):
+    return f"clan_{index}"
+
+
+def generate_roads(rng, clans, topology, degree):
+    """Returns a list of (from, to) index pairs; every topology is connected."""
+    edges = set()
+
+    def add(a, b):
+        if a != b:
+            edges.add((min(a, b), max(a, b)))
+
+    if clans < 2:
+        return []
+
+    if topology == 'ring':
+        for i in range(clans):
+            add(i, (i + 1) % clans)
+    elif topology == 'grid':
+        width = max(1, int(clans ** 0.5))
+        for i in range(clans):
+            if (i + 1) % width != 0 and i + 1 < clans:
+                add(i, i + 1)
+            if i + width < clans:
+                add(i, i + width)
+    elif topology == 'tree':
+        for i in range(1, clans):
+            add(i, rng.randrange(i))
+    elif topology == 'scale-free':
+        # preferential attachment: each new clan connects to m existing clans weighted by degree
+        m = max(1, degree // 2)
+        targets = [0]
+        for i in range(1, clans):
+            chosen = sorted({rng.choice(targets) for _ in range(min(m, i))})
+            for j in chosen:
+                add(i, j)
+            targets.extend(chosen)
+            targets.extend([i] * len(chosen))
+    else:
+        # random spanning tree for connectivity, then random extra roads up to the average degree
+        order = list(range(clans))
+        rng.shuffle(order)
+        for i in range(1, clans):
+            add(order[i], order[rng.randrange(i)])
+        wanted = min(clans * degree // 2, clans * (clans - 1) // 2)
+        while len(edges) < wanted:
+            add(rng.randrange(clans), rng.randrange(clans))
+
+    return sorted(edges)
+
+
+def write_model(path, rng, args):
+    mines = set(rng.sample(range(args.clans), int(round(args.clans * args.mine_ratio))))
+    roads = generate_roads(rng, args.clans, args.topology, args.degree)
+
+    with open(path, 'w') as f:
+        f.write("<Kingdom>\n  <Name>generated_kingdom</Name>\n")
+        for i in range(args.clans):
+            f.write(f"  <Clan>\n    <Name>{clan_name(i)}</Name>\n")
+            if i in mines:
+                f.write("    <IS_MINE>True</IS_MINE>\n")
+                f.write(f"    <MAR>{rng.randint(*args.mar)}</MAR>\n")
+                f.write(f"    <RT>{rng.randint(*args.rt)}</RT>\n")
+                f.write(f"    <PTR>{rng.randint(*args.ptr)}</PTR>\n")
+            else:
+                f.write("    <IS_MINE>False</IS_MINE>\n")
+            f.write("  </Clan>\n")
+        for a, b in roads:
+            f.write(f"  <Road>\n      <From>{clan_name(a)}</From>\n      <To>{clan_name(b)}</To>\n")
+            f.write(f"      <Time>{rng.randint(*args.road_time)}</Time>\n  </Road>\n")
+        f.write("</Kingdom>\n")
+
+    return len(mines), len(roads)
+
+
+def write_queries(path, rng, args):
+    rates = [args.status_rate, args.gold_rate, args.block_rate, args.new_mine_rate, args.new_clan_rate]
+    if sum(rates) > 1:
+        raise ValueError("query rates add up to more than 1")
+
+    thresholds = []
+    total = 0.0
+    for rate in rates:
+        total += rate
+        thresholds.append(total)
+
+    clans = args.clans
+    time = 0
+    lines = ["0: Process inputs"]
+    counts = dict.fromkeys(QUERY_KINDS + ('attack',), 0)
+
+    with open(path, 'w') as f:
+        for _ in range(args.queries):
+            time += rng.randint(*args.time_step)
+            r = rng.random()
+            kind = next((QUERY_KINDS[i] for i, t in enumerate(thresholds) if r < t), 'attack')
+            counts[kind] += 1
+
+            if kind == 'attack':
+                rr = rng.randint(*args.rr)
+                gco = rng.randint(*args.gco)
+                lines.append(f"{time}: Attack on {clan_name(rng.randrange(clans))} with {rr} RR providing {gco} GCO")
+            elif kind == 'status':
+                lines.append(f"{time}: Show the current status of all the clans with mines")
+            elif kind == 'gold':
+                lines.append(f"{time}: Produce the current amount of Gold captured")
+            elif kind == 'block':
+                lines.append(f"{time}: {clan_name(rng.randrange(clans))} has been blocked by enemies for {rng.randint(*args.block_duration)} seconds")
+            elif kind == 'mine':
+                lines.append(f"{time}: {clan_name(rng.randrange(clans))} has found natural resource's mine with "
+                             f"{rng.randint(*args.mar)} MAR, {rng.randint(*args.ptr)} PTR and {rng.randint(*args.rt)} RT")
+            else:
+                links = ", ".join(f"{clan_name(rng.randrange(clans))}(with {rng.randint(*args.road_time)} time)"
+                                  for _ in range(rng.randint(1, max(1, args.degree))))
+                lines.append(f"{time}: New {clan_name(clans)} has been formed, which has the connectivity to {links}")
+                clans += 1
+
+            if len(lines) >= 65536:
+                f.write("\n".join(lines) + "\n")
+                lines = []
+
+        # leave room for the last attacks to complete before the final gold report
+        time += rng.randint(*args.time_step) + args.tail
+        lines.append(f"{time}: Produce the current amount of Gold captured")
+        lines.append(f"{time + 1}: Victory of Codeopia")
+        f.write("\n".join(lines) + "\n")
+
+    return counts
+
+
+def build_engine(directory, build_directory):
+    source = os.path.join(directory, 'solution', 'main.cpp')
+    binary = os.path.join(build_directory, 'main.exe' if os.name == 'nt' else 'main')
+    command = ['g++', '-O2', source, '-o', binary, '-I', os.path.join(directory, 'lib', 'cpp', 'pugixml-1.14', 'src')]
+    result = subprocess.run(command, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError(f"Compilation failed: {result.stderr}")
+    return binary
+
+
+def write_reference(engine, model_path, queries_path, output_path):
+    with open(queries_path, 'rb') as queries, open(output_path, 'wb') as output:
+        result = subprocess.run([engine, model_path], stdin=queries, stdout=output, stderr=subprocess.PIPE)
+    if result.returncode != 0 or result.stderr:
+        raise RuntimeError(f"Execution failed: {result.stderr.decode(errors='replace')}")
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Generate a synthetic kingdom model and query trace.")
+    parser.add_argument('--out-dir', default='.', help="directory for the generated files")
+    parser.add_argument('--prefix', default='t1', help="file name prefix (tN in inputs/)")
+    parser.add_argument('--seed', type=int, default=1)
+
+    model = parser.add_argument_group('model')
+    model.add_argument('--clans', type=int, default=100)
+    model.add_argument('--mine-ratio', type=float, default=0.25, help="fraction of clans that own a mine")
+    model.add_argument('--topology', choices=TOPOLOGIES, default='random')
+    model.add_argument('--degree', type=int, default=3, help="target average road degree")
+    model.add_argument('--road-time', type=parse_range, default=(1, 30), metavar='MIN:MAX')
+    model.add_argument('--mar', type=parse_range, default=(10, 200), metavar='MIN:MAX')
+    model.add_argument('--ptr', type=parse_range, default=(1, 3), metavar='MIN:MAX')
+    model.add_argument('--rt', type=parse_range, default=(1, 120), metavar='MIN:MAX')
+
+    trace = parser.add_argument_group('queries')
+    trace.add_argument('--queries', type=int, default=1000, help="number of queries between the first and last line")
+    trace.add_argument('--time-step', type=parse_range, default=(0, 5), metavar='MIN:MAX', help="time between queries")
+    trace.add_argument('--status-rate', type=float, default=0.05)
+    trace.add_argument('--gold-rate', type=float, default=0.05)
+    trace.add_argument('--block-rate', type=float, default=0.05, help="block churn")
+    trace.add_argument('--block-duration', type=parse_range, default=(1, 60), metavar='MIN:MAX')
+    trace.add_argument('--new-mine-rate', type=float, default=0.01)
+    trace.add_argument('--new-clan-rate', type=float, default=0.01)
+    trace.add_argument('--rr', type=parse_range, default=(1, 100), metavar='MIN:MAX', help="resources requested per attack")
+    trace.add_argument('--gco', type=parse_range, default=(1, 50), metavar='MIN:MAX', help="gold per attack")
+    trace.add_argument('--tail', type=int, default=1000, help="time between the last query and the final gold report")
+
+    reference = parser.add_argument_group('reference output').add_mutually_exclusive_group()
+    reference.add_argument('--engine', help="solution binary used to produce <prefix>_output.txt")
+    reference.add_argument('--build', action='store_true', help="compile solution/main.cpp and use it as the engine")
+
+    args = parser.parse_args(argv)
+    if args.clans < 1:
+        parser.error("--clans must be positive")
+    if not 0 <= args.mine_ratio <= 1:
+        parser.error("--mine-ratio must be between 0 and 1")
+
+    os.makedirs(args.out_dir, exist_ok=True)
+    model_path = os.path.join(args.out_dir, f'{args.prefix}_model.xml')
+    queries_path = os.path.join(args.out_dir, f'{args.prefix}_queries.txt')
+
+    # model and trace use separate streams so that changing the query mix keeps the same kingdom
+    mines, roads = write_model(model_path, random.Random(f"{args.seed}:model"), args)
+    counts = write_queries(queries_path, random.Random(f"{args.seed}:queries"), args)
+
+    print(f"{model_path}: {args.clans} clans, {mines} mines, {roads} roads")
+    print(f"{queries_path}: " + ", ".join(f"{count} {kind}" for kind, count in counts.items()))
+
+    if args.engine or args.build:
+        output_path = os.path.join(args.out_dir, f'{args.prefix}_output.txt')
+        with tempfile.TemporaryDirectory(prefix='kingdom_') as build_directory:
+            engine = args.engine
+            if args.build:
+                engine = build_engine(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), build_directory)
+            write_reference(engine, model_path, queries_path, output_path)
+        print(f"{output_path}: reference output written")
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
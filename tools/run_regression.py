@@ -0,0 +1,230 @@
+"""
+Parallel regression harness for the C++ solution.
+
+Builds the entry point that solution_evaluator.py would pick (solution/main.cpp)
+once with optimization flags, caches the binary under .kingdom_cache/ keyed by
+the compiler, the flags and the contents of every source it depends on, and
+then runs all cases concurrently. For each case it reports pass/fail against
+the expected output, wall time and peak RSS of the engine process.
+With --check-evaluator-build it also compiles the sources the way
+solution_evaluator.py does, with no flags beyond the include path, and fails if
+that build does not.
+
+A case is a <prefix>_model.xml with its <prefix>_queries.txt. The expected
+output is <prefix>_output.txt next to the model (as written by
+generate_kingdom.py), or else the file of the same name under golden/ for
+cases under inputs/. Outputs are compared with line endings normalized, since
+the goldens were produced on Windows.
+
+Example:
+    python tools/run_regression.py                      # inputs/, like solution_evaluator.py
+    python tools/run_regression.py gen/L3 -j 16 --json regression.json
+    python tools/run_regression.py --check-evaluator-build
+"""
+
+import argparse
+import concurrent.futures
+import hashlib
+import json
+import os
+import shlex
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, REPO)
+
+from solution_evaluator import find_entry_point_file  # noqa: E402
+
+PUGIXML_SOURCES = os.path.join(REPO, 'lib', 'cpp', 'pugixml-1.14', 'src')
+DEFAULT_FLAGS = '-O2 -pthread'
+# solution_evaluator.py compiles with no flags beyond the include path
+EVALUATOR_FLAGS = ''
+
+
+def source_files(entry_point):
+    """Every file the build depends on: the solution directory and the vendored pugixml."""
+    files = []
+    for directory in (os.path.dirname(entry_point), PUGIXML_SOURCES):
+        for root, _, names in os.walk(directory):
+            files.extend(os.path.join(root, name) for name in names
+                         if name.endswith(('.cpp', '.hpp', '.h')))
+    return sorted(files)
+
+
+def build_key(compiler, flags, entry_point):
+    digest = hashlib.sha256()
+    version = subprocess.run([compiler, '--version'], capture_output=True, text=True)
+    digest.update(version.stdout.encode())
+    digest.update(flags.encode())
+    for path in source_files(entry_point):
+        digest.update(os.path.relpath(path, REPO).encode())
+        with open(path, 'rb') as f:
+            digest.update(f.read())
+    return digest.hexdigest()[:16]
+
+
+def cached_build(compiler, flags, entry_point, cache_dir, rebuild):
+    """Returns (binary, built) for the current sources, compiling only if the cache has no match."""
+    key = build_key(compiler, flags, entry_point)
+    os.makedirs(cache_dir, exist_ok=True)
+    binary = os.path.join(cache_dir, f'main-{key}' + ('.exe' if os.name == 'nt' else ''))
+    if os.path.exists(binary) and not rebuild:
+        return binary, False
+
+    # compile next to the final name and rename, so concurrent harnesses never see a partial binary
+    fd, partial = tempfile.mkstemp(dir=cache_dir, prefix='building-')
+    os.close(fd)
+    command = [compiler, *shlex.split(flags), entry_point, '-o', partial, '-I', PUGIXML_SOURCES]
+    result = subprocess.run(command, capture_output=True, text=True)
+    if result.returncode != 0:
+        # a failed link has already removed it
+        if os.path.exists(partial):
+            os.remove(partial)
+        raise RuntimeError(f"Compilation failed: {result.stderr}")
+    os.replace(partial, binary)
+    return binary, True
+
+
+def find_cases(directories):
+    """Yields (name, model, queries, expected) for every model under the given directories."""
+    inputs_directory = os.path.join(REPO, 'inputs')
+    golden_directory = os.path.join(REPO, 'golden')
+    for directory in directories:
+        for root, _, files in os.walk(directory):
+            for file in sorted(files):
+                if not file.endswith('.xml'):
+                    continue
+                prefix = file.split('_')[0]
+                model = os.path.join(root, file)
+                queries = os.path.join(root, f'{prefix}_queries.txt')
+                expected = os.path.join(root, f'{prefix}_output.txt')
+                relative = os.path.relpath(os.path.abspath(root), inputs_directory)
+                if not os.path.exists(expected) and not relative.startswith(os.pardir):
+                    expected = os.path.join(golden_directory, relative, f'{prefix}_output.txt')
+                name = os.path.normpath(os.path.join(os.path.relpath(root, directory), prefix))
+                yield name, model, queries, expected if os.path.exists(expected) else None
+
+
+def normalized(data):
+    return data.replace(b'\r\n', b'\n').rstrip(b'\n')
+
+
+def run_case(binary, case, outputs_directory, timeout):
+    name, model, queries, expected = case
+    output_path = os.path.join(outputs_directory, f'{name}_output.txt')
+    os.makedirs(os.path.dirname(output_path), exist_ok=True)
+
+    peak_rss = None
+    timed_out = threading.Event()
+    with open(queries, 'rb') as stdin, open(output_path, 'wb') as stdout, tempfile.TemporaryFile() as stderr:
+        start = time.perf_counter()
+        process = subprocess.Popen([binary, model], stdin=stdin, stdout=stdout, stderr=stderr)
+
+        def kill():
+            timed_out.set()
+            process.kill()
+
+        timer = threading.Timer(timeout, kill) if timeout else None
+        if timer:
+            timer.start()
+        if hasattr(os, 'wait4'):
+            # wait4 reports the resource usage of exactly this child, including its peak RSS
+            _, status, usage = os.wait4(process.pid, 0)
+            process.returncode = os.waitstatus_to_exitcode(status)
+            # ru_maxrss is in kilobytes on Linux and in bytes on macOS
+            peak_rss = usage.ru_maxrss * (1 if sys.platform == 'darwin' else 1024)
+        else:
+            process.wait()
+        wall = time.perf_counter() - start
+        if timer:
+            timer.cancel()
+        stderr.seek(0)
+        errors = stderr.read().decode(errors='replace').strip()
+
+    if timed_out.is_set():
+        status = 'TIMEOUT'
+    elif process.returncode != 0 or errors:
+        status = 'ERROR'
+    elif expected is None:
+        status = 'NO-GOLDEN'
+    else:
+        with open(output_path, 'rb') as actual, open(expected, 'rb') as golden:
+            status = 'PASS' if normalized(actual.read()) == normalized(golden.read()) else 'FAIL'
+    return {'case': name, 'status': status, 'wall_seconds': wall, 'peak_rss_bytes': peak_rss,
+            'returncode': process.returncode, 'stderr': errors[:2000]}
+
+
+def format_rss(value):
+    return '-' if value is None else f'{value / (1 << 20):.1f} MB'
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description="Build the solution once and run all regression cases in parallel.")
+    parser.add_argument('directories', nargs='*', help="case directories (default: inputs/)")
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count() or 1, help="cases run at the same time")
+    parser.add_argument('--compiler', default='g++')
+    parser.add_argument('--flags', default=DEFAULT_FLAGS, help=f"compiler flags (default: {DEFAULT_FLAGS})")
+    parser.add_argument('--cache-dir', default=os.path.join(REPO, '.kingdom_cache'))
+    parser.add_argument('--rebuild', action='store_true', help="compile even if a cached binary matches")
+    parser.add_argument('--check-evaluator-build', action='store_true',
+                        help="also compile with solution_evaluator.py's command line (no flags) and fail if it doesn't build")
+    parser.add_argument('--outputs', default=os.path.join(REPO, 'outputs'), help="where engine outputs are written")
+    parser.add_argument('--timeout', type=float, default=0, help="seconds per case, 0 for none")
+    parser.add_argument('--json', help="also write the results to this file")
+    args = parser.parse_args(argv)
+
+    entry_point = find_entry_point_file(os.path.join(REPO, 'solution'))
+    if entry_point is None or not entry_point.endswith('.cpp'):
+        print(f"No C++ entry point found in the 'solution' directory (found: {entry_point}).")
+        return 1
+
+    if args.check_evaluator_build:
+        # builds that only work with optimization (e.g. an ODR-used constant without a definition) fail to link here
+        start = time.perf_counter()
+        try:
+            evaluator_binary, built = cached_build(args.compiler, EVALUATOR_FLAGS, entry_point, args.cache_dir, args.rebuild)
+        except RuntimeError as error:
+            print(f"Evaluator build failed: {error}")
+            return 1
+        print(f"{'Built' if built else 'Cached'} {os.path.relpath(evaluator_binary, REPO)} (evaluator flags) in {time.perf_counter() - start:.1f} s")
+
+    start = time.perf_counter()
+    binary, built = cached_build(args.compiler, args.flags, entry_point, args.cache_dir, args.rebuild)
+    print(f"{'Built' if built else 'Cached'} {os.path.relpath(binary, REPO)} in {time.perf_counter() - start:.1f} s")
+
+    directories = args.directories or [os.path.join(REPO, 'inputs')]
+    cases = list(find_cases(directories))
+    if not cases:
+        print("No cases found.")
+        return 1
+
+    start = time.perf_counter()
+    results = []
+    with concurrent.futures.ThreadPoolExecutor(max_workers=max(1, args.jobs)) as pool:
+        futures = [pool.submit(run_case, binary, case, args.outputs, args.timeout) for case in cases]
+        for future in concurrent.futures.as_completed(futures):
+            result = future.result()
+            results.append(result)
+            print(f"{result['status']:<9} {result['case']:<40} {result['wall_seconds']:9.3f} s  {format_rss(result['peak_rss_bytes']):>10}")
+            if result['stderr']:
+                print(f"          {result['stderr']}")
+    total = time.perf_counter() - start
+
+    results.sort(key=lambda r: r['case'])
+    passed = sum(r['status'] == 'PASS' for r in results)
+    print(f"{passed}/{len(results)} passed in {total:.1f} s with {args.jobs} jobs")
+
+    if args.json:
+        with open(args.json, 'w') as f:
+            json.dump({'binary': os.path.relpath(binary, REPO), 'flags': args.flags, 'jobs': args.jobs,
+                       'wall_seconds': total, 'results': results}, f, indent=2)
+
+    return 0 if passed == len(results) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))